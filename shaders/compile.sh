@@ -0,0 +1,8 @@
+#!/bin/sh
+# compiles the GLSL sources next to this script to the .spv files the application loads at runtime
+cd "$(dirname "$0")"
+glslc shader.vert -o vert.spv
+glslc shader.frag -o frag.spv
+glslc mesh.vert -o mesh_vert.spv
+glslc instanced.vert -o instanced_vert.spv
+glslc cull.comp -o cull_comp.spv
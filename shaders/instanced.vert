@@ -0,0 +1,23 @@
+#version 450
+
+// MeshVertex, placed by the instance the cull shader's draw command points at
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragColor;
+
+// same layout as in cull.comp
+layout(set = 0, binding = 0) readonly buffer Instances { float instanceData[]; };
+
+layout(push_constant) uniform Camera {
+	mat4 viewProjection;
+	uint instanceCount;
+};
+
+void main() {
+	uint instance = gl_InstanceIndex; // the draw's firstInstance
+	vec3 center = vec3(instanceData[instance], instanceData[instanceCount + instance], instanceData[2 * instanceCount + instance]);
+	float scale = instanceData[3 * instanceCount + instance];
+	gl_Position = viewProjection * vec4(center + inPosition * scale, 1.0);
+	fragColor = inNormal * 0.5 + 0.5;
+}
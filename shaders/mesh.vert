@@ -0,0 +1,12 @@
+#version 450
+
+// MeshVertex, positions were fitted into [-1, 1] by the converter so no camera is needed
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+	gl_Position = vec4(inPosition.x, -inPosition.y, inPosition.z * 0.5 + 0.5, 1.0); // y points up in the file, down in clip space
+	fragColor = inNormal * 0.5 + 0.5;
+}
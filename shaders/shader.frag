@@ -0,0 +1,18 @@
+#version 450
+
+// specialized per pipeline variant: 0 = vertex color, 1 = grayscale, 2 = inverted
+layout(constant_id = 0) const int COLOR_MODE = 0;
+
+layout(location = 0) in vec3 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	vec3 color = fragColor;
+	if (COLOR_MODE == 1) {
+		color = vec3(dot(color, vec3(0.299, 0.587, 0.114)));
+	} else if (COLOR_MODE == 2) {
+		color = vec3(1.0) - color;
+	}
+	outColor = vec4(color, 1.0);
+}
@@ -5,12 +5,37 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <vector>
-#include <cstring> // strcmp
-#include <map> // multimap
+#include <cstring> // strcmp, memcpy
+#include <map> // multimap, map
 #include <optional>
 #include <set>
 #include <limits> // std::numeric_limits
 #include <algorithm> // std::clamp
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <atomic>
+#include <new> // std::bad_alloc
+#include <future>
+#include <tuple>
+#include <mutex>
+#include <array>
+#include <iomanip>
+#include <memory>
+#include <deque>
+#include <cmath>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <sys/mman.h> // mmap
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifdef NDEBUG
 	const bool enableValidationLayers = false;
@@ -28,481 +53,7059 @@ const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation",
 };
 
-const std::vector<const char*> deviceExtensions = {
-	"VK_KHR_swapchain", //can also use macro: VK_KHR_SWAPCHAIN_EXTENSION_NAME
+struct DeviceExtension {
+	const char *name;
+	bool required;          // devices without it are skipped, optional ones are enabled where present
+	bool needsProperties2;  // only usable with VK_KHR_get_physical_device_properties2 on the instance
 };
 
+const std::vector<DeviceExtension> deviceExtensions = {
+	{"VK_KHR_swapchain", true, false}, //can also use macro: VK_KHR_SWAPCHAIN_EXTENSION_NAME
+	{VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, false, true}, // live heap budget for texture streaming, heap sizes otherwise
+	{VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, false, false}, // compacted GPU culling output, else culled draws stay in with 0 instances
+	{VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME, false, false}, // pipeline cache hits as the driver saw them, else compile times only
+};
 
-VkResult createDebugUtilsMessengerEXT(
-	VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-	const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pDebugMessenger) {
-		
-	auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
-	VkResult result;
-	if (func != nullptr) {
-		result = func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-	} else { 
-		result = VK_ERROR_EXTENSION_NOT_PRESENT;
+// instance extensions needed to present without a window system (e.g. lavapipe on a batch node)
+const std::vector<const char*> headlessExtensions = {
+	VK_KHR_SURFACE_EXTENSION_NAME,
+	VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME,
+};
+
+/* present mode, swapchain depth and frames in flight pull latency and throughput in opposite directions,
+   so they're picked together */
+enum class PresentPolicy { Balanced, LowLatency, VsyncThroughput, Uncapped };
+
+struct PresentPolicySettings {
+	const char *name;
+	std::vector<VkPresentModeKHR> presentModes; // first supported one wins, FIFO is always there as a last resort
+	uint32_t extraImages;    // on top of minImageCount
+	uint32_t framesInFlight;
+};
+
+const PresentPolicySettings& presentPolicySettings(PresentPolicy policy) {
+	static const PresentPolicySettings settings[] = {
+		// mailbox without tearing, one spare image so acquire rarely blocks on the driver
+		{"balanced", {VK_PRESENT_MODE_MAILBOX_KHR}, 1, 2},
+		// newest frame wins and the CPU never runs ahead, so input is sampled as late as possible
+		{"low-latency", {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR}, 1, 1},
+		// every frame is shown, the deeper queue keeps the GPU busy through CPU hiccups
+		{"vsync-throughput", {VK_PRESENT_MODE_FIFO_KHR}, 2, 3},
+		// no vsync at all, tears, for measuring how fast we can go
+		{"uncapped", {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR}, 1, 2},
+	};
+	return settings[static_cast<size_t>(policy)];
+}
+
+const char* presentModeName(VkPresentModeKHR mode) {
+	switch (mode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+		default: return "other";
 	}
-	return result;
 }
 
-void destroyDebugUtilsMessengerEXT(VkInstance instance, 
-	VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks *pAllocator) {
-		
-	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-	
-	func(instance, debugMessenger, pAllocator);
+// raw: one tightly packed RGBA8 file per frame, ppm: one P6 file per frame, stream: every frame appended to one file
+enum class CaptureFormat { Raw, Ppm, Stream };
+
+struct AppOptions {
+	bool headless = false;       // no GLFW window, present to a VK_EXT_headless_surface instead
+	uint32_t frameCount = 0;     // stop after this many frames, 0 = run until the window closes
+	uint32_t framesInFlight = 0; // CPU may record this many frames ahead of the GPU, capped by the swapchain image count, 0 = what presentPolicy says
+	PresentPolicy presentPolicy = PresentPolicy::Balanced;
+	std::string pipelineCachePath = "pipeline_cache.bin"; // empty = don't persist
+	std::string startupTracePath;  // write a Chrome trace of initWindow()/initVulkan() here
+	std::string deviceCachePath;   // keep device properties, features, queue families and extensions between runs
+	bool useHostAllocator = true;  // route driver host allocations through HostAllocator instead of the driver's malloc
+	uint32_t uploadRingMiB = 32;   // staging ring for streaming uploads
+	uint32_t recordThreads = 1;    // threads recording draw work into secondary command buffers, 1 = record inline on the main thread
+	uint32_t drawCount = 1;        // draws per frame, to give command recording something to scale with
+	std::string gpuTracePath;      // GPU timestamps per pass, written with the CPU side of the frame loop as one Chrome trace
+	uint32_t gpuTraceFrames = 300; // frames to put in the trace, the GPU summary covers all of them
+	bool debugLabels = false;      // VK_EXT_debug_utils labels around passes even without validation layers, for capture tools
+	std::string capturePath;       // write every presented frame here: a file name prefix, or the file for CaptureFormat::Stream
+	CaptureFormat captureFormat = CaptureFormat::Ppm;
+	uint32_t captureBuffers = 8;   // readback buffers between the GPU and the writer thread
+	bool bindless = true;          // global descriptor table when VK_EXT_descriptor_indexing is there
+	bool timelines = true;         // queue timelines on VK_KHR_timeline_semaphore when the device has it, fences and binary semaphores otherwise
+	uint32_t colorMode = 0;        // COLOR_MODE specialization constant of the fragment shader
+	uint32_t pipelineThreads = 0;  // background pipeline compile threads, 0 = one per variant up to the core count
+	std::string meshPath;          // mesh file written by --convert-mesh, drawn instead of the triangle
+	std::string texturePath;       // directory of PPM files to stream, e.g. frames written by --capture
+	uint32_t textureBudgetMiB = 256; // streamed textures never use more, even if the heap budget allows it
+	bool fastStart = false;        // window, instance and file reads in parallel, no device listings, other startup output held back until the first frame
+	uint32_t benchStartupRuns = 0; // --bench-startup: compare time to first frame of normal and fast start over this many runs each
+	bool blur = false;             // render offscreen and blur into the swapchain image through two transient downsampled images
+	uint32_t instanceCount = 0;    // copies of the mesh (or triangle) culled on the GPU and drawn indirect, replaces the direct draws
+	bool defragment = false;       // mesh buffers are movable and get packed into the fullest blocks once after the first frame
+	std::string benchPath;         // --bench: run the benchmark suite headless and write its JSON here
+	std::string benchBaselinePath; // an earlier --bench JSON to flag regressions against
+	uint32_t benchWarmup = 2;      // repetitions run before the recorded ones
+	uint32_t benchRepetitions = 10;
+	double benchTolerance = 0.05;  // slowdown a regression needs on top of being outside the noise
+	bool benchAllowDeviceMismatch = false; // compare against a baseline measured on another device instead of failing
+};
+
+
+// every operator new in the process goes through these, so a scope can report how much it allocated
+std::atomic<uint64_t> hostAllocationCount{0};
+std::atomic<uint64_t> hostAllocationBytes{0};
+
+void* operator new(size_t size) {
+	hostAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	hostAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+	void *memory = std::malloc(size ? size : 1);
+	if (!memory) throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void *memory) noexcept {
+	std::free(memory);
 }
 
+void operator delete(void *memory, size_t) noexcept {
+	std::free(memory);
+}
 
-class HelloTriangleApplication {
-	
-public:
 
-    void run() {
-		initWindow();
-        initVulkan();
-        mainLoop();
-        cleanup();
-    }
+// driver host allocations made through HostAllocator, sampled by ScopedTimer like the two above
+std::atomic<uint64_t> vulkanAllocationCount{0};
+std::atomic<uint64_t> vulkanAllocationBytes{0};
 
+
+/* VkAllocationCallbacks backed by size-class free lists, one arena per VkSystemAllocationScope.
+   command-scope allocations churn every frame while instance/device-scope ones live for the whole run,
+   keeping them in separate arenas stops the short-lived ones from fragmenting around the long-lived ones
+   and lets threads allocating in different scopes proceed without contending on one lock */
+class HostAllocator {
+public:
+	static constexpr size_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	
+	struct ScopeStats {
+		uint64_t allocations = 0;      // total, including reallocations that moved
+		uint64_t frees = 0;
+		uint64_t liveAllocations = 0;
+		uint64_t liveBytes = 0;        // as requested by the driver
+		uint64_t peakBytes = 0;
+		uint64_t reservedBytes = 0;    // slabs and large blocks obtained from malloc
+		uint64_t internalBytes = 0;    // reported through pfnInternalAllocation (e.g. executable memory)
+	};
+	
+	HostAllocator() {
+		callbacks.pUserData = this;
+		callbacks.pfnAllocation = &allocationCallback;
+		callbacks.pfnReallocation = &reallocationCallback;
+		callbacks.pfnFree = &freeCallback;
+		callbacks.pfnInternalAllocation = &internalAllocationCallback;
+		callbacks.pfnInternalFree = &internalFreeCallback;
+	}
+	
+	~HostAllocator() {
+		for (auto& arena : arenas) {
+			for (void *slab : arena.slabs) {
+				std::free(slab);
+			}
+		}
+	}
+	
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+	
+	const VkAllocationCallbacks* getCallbacks() const { return &callbacks; }
+	
+	ScopeStats getStats(VkSystemAllocationScope scope) {
+		Arena& arena = arenas[scope];
+		std::lock_guard<std::mutex> lock(arena.mutex);
+		return arena.stats;
+	}
+	
+	void printStats(std::ostream& out) {
+		static const char *scopeNames[SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+		out << "driver host allocations per scope:\n";
+		for (size_t scope = 0 ; scope < SCOPE_COUNT ; ++scope) {
+			ScopeStats stats = getStats(static_cast<VkSystemAllocationScope>(scope));
+			out << '\t' << std::setw(8) << scopeNames[scope] << " : " << stats.allocations << " allocations, "
+				<< stats.liveAllocations << " live (" << stats.liveBytes << " bytes), peak " << stats.peakBytes
+				<< " bytes, reserved " << stats.reservedBytes << " bytes, internal " << stats.internalBytes << " bytes\n";
+		}
+	}
+	
 private:
+	// sits right in front of every pointer handed to the driver
+	struct alignas(16) Header {
+		void *block;
+		size_t blockBytes;
+		size_t size;
+		uint32_t sizeClass;
+		uint32_t scope;
+	};
+	static constexpr size_t HEADER_SIZE = sizeof(Header);
+	static constexpr size_t BLOCK_ALIGNMENT = 16;   // malloc and slab carving both guarantee this
+	static constexpr size_t MIN_BLOCK_SIZE = 64;
+	static constexpr size_t SIZE_CLASS_COUNT = 8;   // 64 bytes .. 8 KiB
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+	static constexpr uint32_t LARGE_CLASS = ~0u;    // straight from malloc, returned to free()
+	
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+	
+	struct Arena {
+		std::mutex mutex;
+		std::array<FreeBlock*, SIZE_CLASS_COUNT> freeLists{};
+		std::vector<void*> slabs;
+		ScopeStats stats;
+	};
+	
+	VkAllocationCallbacks callbacks{};
+	std::array<Arena, SCOPE_COUNT> arenas;
+	
+	static size_t blockSize(uint32_t sizeClass) {
+		return MIN_BLOCK_SIZE << sizeClass;
+	}
+	
+	static uint32_t sizeClassFor(size_t blockBytes) {
+		uint32_t sizeClass = 0;
+		while (sizeClass < SIZE_CLASS_COUNT && blockSize(sizeClass) < blockBytes) {
+			++sizeClass;
+		}
+		return sizeClass < SIZE_CLASS_COUNT ? sizeClass : LARGE_CLASS;
+	}
+	
+	// worst case bytes a block needs so that an aligned pointer with a header in front fits
+	static size_t blockBytesFor(size_t size, size_t alignment) {
+		size_t padding = alignment > BLOCK_ALIGNMENT ? alignment - BLOCK_ALIGNMENT : 0;
+		return size + HEADER_SIZE + padding;
+	}
+	
+	static Header* headerOf(void *memory) {
+		return reinterpret_cast<Header*>(static_cast<char*>(memory) - HEADER_SIZE);
+	}
+	
+	static size_t capacityOf(void *memory) {
+		Header *header = headerOf(memory);
+		size_t used = static_cast<char*>(memory) - static_cast<char*>(header->block);
+		return header->blockBytes - used;
+	}
+	
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		if (size == 0) return nullptr;
+		if (alignment == 0 || (alignment & (alignment - 1)) != 0) return nullptr;
+		
+		size_t blockBytes = blockBytesFor(size, alignment);
+		uint32_t sizeClass = sizeClassFor(blockBytes);
+		Arena& arena = arenas[scope];
+		
+		void *block = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			if (sizeClass == LARGE_CLASS) {
+				block = std::malloc(blockBytes);
+				if (!block) return nullptr;
+				arena.stats.reservedBytes += blockBytes;
+			} else {
+				if (!arena.freeLists[sizeClass] && !refill(arena, sizeClass)) return nullptr;
+				FreeBlock *head = arena.freeLists[sizeClass];
+				arena.freeLists[sizeClass] = head->next;
+				block = head;
+				blockBytes = blockSize(sizeClass);
+			}
+			++arena.stats.allocations;
+			++arena.stats.liveAllocations;
+			arena.stats.liveBytes += size;
+			arena.stats.peakBytes = std::max(arena.stats.peakBytes, arena.stats.liveBytes);
+		}
+		vulkanAllocationCount.fetch_add(1, std::memory_order_relaxed);
+		vulkanAllocationBytes.fetch_add(size, std::memory_order_relaxed);
+		
+		uintptr_t address = reinterpret_cast<uintptr_t>(block) + HEADER_SIZE;
+		address = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+		void *memory = reinterpret_cast<void*>(address);
+		*headerOf(memory) = Header{block, blockBytes, size, sizeClass, static_cast<uint32_t>(scope)};
+		return memory;
+	}
+	
+	void free(void *memory) {
+		if (!memory) return;
+		Header header = *headerOf(memory);
+		Arena& arena = arenas[header.scope];
+		
+		std::lock_guard<std::mutex> lock(arena.mutex);
+		if (header.sizeClass == LARGE_CLASS) {
+			arena.stats.reservedBytes -= header.blockBytes;
+			std::free(header.block);
+		} else {
+			FreeBlock *freed = static_cast<FreeBlock*>(header.block);
+			freed->next = arena.freeLists[header.sizeClass];
+			arena.freeLists[header.sizeClass] = freed;
+		}
+		++arena.stats.frees;
+		--arena.stats.liveAllocations;
+		arena.stats.liveBytes -= header.size;
+	}
+	
+	void* reallocate(void *original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		if (!original) return allocate(size, alignment, scope);
+		if (size == 0) {
+			free(original);
+			return nullptr;
+		}
+		
+		// grow or shrink in place if the block is big enough and the pointer already has the requested alignment
+		Header *header = headerOf(original);
+		bool aligned = (reinterpret_cast<uintptr_t>(original) & (alignment - 1)) == 0;
+		if (aligned && header->sizeClass != LARGE_CLASS && capacityOf(original) >= size) {
+			Arena& arena = arenas[header->scope];
+			std::lock_guard<std::mutex> lock(arena.mutex);
+			arena.stats.liveBytes = arena.stats.liveBytes - header->size + size;
+			arena.stats.peakBytes = std::max(arena.stats.peakBytes, arena.stats.liveBytes);
+			header->size = size;
+			return original;
+		}
+		
+		void *memory = allocate(size, alignment, scope);
+		if (!memory) return nullptr; // the original stays valid, as the spec requires
+		std::memcpy(memory, original, std::min(size, header->size));
+		free(original);
+		return memory;
+	}
+	
+	// carve a fresh slab into blocks of one size class; caller holds the arena lock
+	bool refill(Arena& arena, uint32_t sizeClass) {
+		void *slab = std::malloc(SLAB_SIZE);
+		if (!slab) return false;
+		arena.slabs.push_back(slab);
+		arena.stats.reservedBytes += SLAB_SIZE;
+		
+		size_t size = blockSize(sizeClass);
+		char *begin = static_cast<char*>(slab);
+		for (size_t offset = SLAB_SIZE / size * size ; offset >= size ; offset -= size) {
+			FreeBlock *block = reinterpret_cast<FreeBlock*>(begin + offset - size);
+			block->next = arena.freeLists[sizeClass];
+			arena.freeLists[sizeClass] = block;
+		}
+		return true;
+	}
+	
+	static VKAPI_ATTR void* VKAPI_CALL allocationCallback(void *pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		return static_cast<HostAllocator*>(pUserData)->allocate(size, alignment, scope);
+	}
+	
+	static VKAPI_ATTR void* VKAPI_CALL reallocationCallback(void *pUserData, void *pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		return static_cast<HostAllocator*>(pUserData)->reallocate(pOriginal, size, alignment, scope);
+	}
+	
+	static VKAPI_ATTR void VKAPI_CALL freeCallback(void *pUserData, void *pMemory) {
+		static_cast<HostAllocator*>(pUserData)->free(pMemory);
+	}
+	
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(void *pUserData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+		Arena& arena = static_cast<HostAllocator*>(pUserData)->arenas[scope];
+		std::lock_guard<std::mutex> lock(arena.mutex);
+		arena.stats.internalBytes += size;
+	}
+	
+	static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(void *pUserData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+		Arena& arena = static_cast<HostAllocator*>(pUserData)->arenas[scope];
+		std::lock_guard<std::mutex> lock(arena.mutex);
+		arena.stats.internalBytes -= size;
+	}
+};
 
-	GLFWwindow *window;
-	VkInstance instance;
-	VkDebugUtilsMessengerEXT debugMessenger;
-	VkSurfaceKHR surface;
-	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-	VkDevice device;
-	VkQueue graphicsQueue, presentQueue;
-	VkSwapchainKHR swapchain;
-	std::vector<VkImage> swapchainImages;
-	VkFormat swapchainImageFormat;
-	VkExtent2D swapchainImageExtent;
+
+/* carves buffers and images out of large VkDeviceMemory blocks instead of one vkAllocateMemory per resource.
+   long-lived resources use a buddy allocator per block, per-frame data a bump pointer per frame in flight
+   that is reset wholesale once the GPU has finished that frame. linear (buffers) and optimal (images)
+   resources never share a block when bufferImageGranularity > 1, so they can't end up on the same page */
+class DeviceMemoryAllocator {
+	struct Block;
 	
-	struct QueueFamilyIndices {
-		std::optional<uint32_t> graphicsFamily;
-		std::optional<uint32_t> presentFamily;
+public:
+	enum class Lifetime { Persistent, Frame };
+	
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void *mapped = nullptr; // host-visible memory stays mapped for the lifetime of its block
+		uint32_t memoryTypeIndex = 0;
+		Lifetime lifetime = Lifetime::Persistent;
+		Block *block = nullptr; // nullptr for dedicated and frame allocations
+		uint32_t order = 0;
+	};
+	
+	struct Buffer {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkDeviceSize size = 0;
+		VkBufferUsageFlags usage = 0;
+		bool movable = false; // defragment() may move it, re-read buffer afterwards
+	};
+	
+	struct Image {
+		VkImage image = VK_NULL_HANDLE;
+		Allocation allocation;
+	};
+	
+	struct Stats {
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize reservedBytes = 0;   // in VkDeviceMemory objects we own
+		VkDeviceSize usedBytes = 0;       // handed out, rounded up to buddy nodes
+		VkDeviceSize requestedBytes = 0;  // as the resources asked for
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeRange = 0;
+		VkDeviceSize contiguousFreeBytes = 0; // sum of the largest free range of every block
+		VkDeviceSize frameArenaBytes = 0;
 		
-		bool isComplete(){
-			bool complete = graphicsFamily.has_value() && presentFamily.has_value();
-			return complete;
+		// 0 = each block's free space is one contiguous range, towards 1 = free space is scattered in small pieces
+		double fragmentation() const {
+			return freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(contiguousFreeBytes) / static_cast<double>(freeBytes);
+		}
+		double utilization() const {
+			return reservedBytes == 0 ? 0.0 : static_cast<double>(requestedBytes) / static_cast<double>(reservedBytes);
 		}
 	};
 	
-	struct SwapchainSupportDetails {
-		VkSurfaceCapabilitiesKHR capabilities;
-		std::vector<VkSurfaceFormatKHR> formats;
-		std::vector<VkPresentModeKHR> presentModes;
+	struct DefragmentationStats {
+		uint32_t buffersMoved = 0;
+		VkDeviceSize bytesMoved = 0;
+		uint32_t blocksReleased = 0;
 	};
 	
-	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
-		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-		VkDebugUtilsMessageTypeFlagsEXT messageType,
-		const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-		void *pUserData) {
-			
-		std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator) {
+		this->device = device;
+		this->allocator = allocator;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		bufferImageGranularity = properties.limits.bufferImageGranularity;
+		maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+	}
+	
+	void destroy() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& arena : frameArenas) {
+			for (auto& chunk : arena.chunks) {
+				freeDeviceMemory(chunk.memory);
+			}
+		}
+		frameArenas.clear();
+		// the handles go before the memory they are bound to, including old copies a defragment() left behind
+		for (auto& move : pendingMoves) {
+			vkDestroyBuffer(device, move.oldBuffer, allocator);
+		}
+		pendingMoves.clear();
+		for (Buffer *buffer : buffers) {
+			vkDestroyBuffer(device, buffer->buffer, allocator);
+			delete buffer;
+		}
+		buffers.clear();
+		for (auto& block : blocks) {
+			freeDeviceMemory(block->memory);
+		}
+		blocks.clear();
+	}
+	
+	void createFrameArenas(uint32_t frameCount) {
+		std::lock_guard<std::mutex> lock(mutex);
+		frameArenas.resize(frameCount);
+	}
+	
+	// everything allocated with Lifetime::Frame for this frame index is gone after this, only call once the GPU finished it
+	void resetFrameArena(uint32_t frameIndex) {
+		std::lock_guard<std::mutex> lock(mutex);
+		currentFrame = frameIndex;
+		for (auto& chunk : frameArenas[frameIndex].chunks) {
+			chunk.offset = 0;
+		}
+	}
+	
+	uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const {
+		for (VkMemoryPropertyFlags wanted : {required | preferred, required}) {
+			for (uint32_t i = 0 ; i < memoryProperties.memoryTypeCount ; ++i) {
+				if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+					return i;
+				}
+			}
+		}
+		throw std::runtime_error("no suitable memory type");
+	}
+	
+	const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const { return memoryProperties; }
+	
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, Lifetime lifetime, bool optimalImage) {
+		std::lock_guard<std::mutex> lock(mutex);
+		uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, required, preferred);
+		if (lifetime == Lifetime::Frame) {
+			if (optimalImage) {
+				throw std::runtime_error("frame arenas only hold buffers");
+			}
+			return allocateFromFrameArena(requirements, memoryTypeIndex);
+		}
+		return allocatePersistent(requirements, memoryTypeIndex, optimalImage ? ResourceKind::Optimal : ResourceKind::Linear, nullptr);
+	}
+	
+	void free(Allocation& allocation) {
+		std::lock_guard<std::mutex> lock(mutex);
+		freeLocked(allocation);
+	}
+	
+	Buffer* createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0,
+	                     Lifetime lifetime = Lifetime::Persistent, bool movable = false) {
+		if (movable) {
+			usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT; // defragment() copies it
+		}
 		
-		return VK_FALSE;
+		auto buffer = std::make_unique<Buffer>();
+		buffer->size = size;
+		buffer->usage = usage;
+		buffer->movable = movable && lifetime == Lifetime::Persistent;
+		buffer->buffer = createBufferHandle(size, usage);
+		
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device, buffer->buffer, &requirements);
+		try {
+			buffer->allocation = allocate(requirements, required, preferred, lifetime, false);
+		} catch (...) {
+			vkDestroyBuffer(device, buffer->buffer, allocator);
+			throw;
+		}
+		vkBindBufferMemory(device, buffer->buffer, buffer->allocation.memory, buffer->allocation.offset);
+		
+		std::lock_guard<std::mutex> lock(mutex);
+		buffers.insert(buffer.get());
+		return buffer.release();
 	}
-
-	void initWindow() {
-		glfwInit();
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Tutorial", nullptr, nullptr);
+	
+	void destroyBuffer(Buffer *buffer) {
+		if (!buffer) return;
+		vkDestroyBuffer(device, buffer->buffer, allocator);
+		std::lock_guard<std::mutex> lock(mutex);
+		freeLocked(buffer->allocation);
+		buffers.erase(buffer);
+		delete buffer;
+	}
+	
+	Image createImage(const VkImageCreateInfo& createInfo, VkMemoryPropertyFlags required) {
+		Image image{};
+		if (vkCreateImage(device, &createInfo, allocator, &image.image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create image");
+		}
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(device, image.image, &requirements);
+		try {
+			image.allocation = allocate(requirements, required, 0, Lifetime::Persistent, createInfo.tiling == VK_IMAGE_TILING_OPTIMAL);
+		} catch (...) {
+			vkDestroyImage(device, image.image, allocator);
+			throw;
+		}
+		vkBindImageMemory(device, image.image, image.allocation.memory, image.allocation.offset);
+		return image;
+	}
+	
+	void destroyImage(Image& image) {
+		vkDestroyImage(device, image.image, allocator);
+		free(image.allocation);
+		image = {};
+	}
+	
+	/* moves movable buffers out of the sparsest blocks into denser ones, recording the copies into commandBuffer.
+	   the moved Buffers already point at their new VkBuffer; call finishDefragmentation() once commandBuffer
+	   has finished executing to destroy the old copies and release the blocks that became empty */
+	DefragmentationStats defragment(VkCommandBuffer commandBuffer, VkDeviceSize maxBytesToMove = std::numeric_limits<VkDeviceSize>::max()) {
+		std::lock_guard<std::mutex> lock(mutex);
+		DefragmentationStats stats{};
+		
+		std::vector<Block*> sources;
+		for (auto& block : blocks) {
+			if (block->allocationCount > 0 && !block->dedicated) sources.push_back(block.get());
+		}
+		std::sort(sources.begin(), sources.end(), [](const Block *a, const Block *b) { return a->usedBytes < b->usedBytes; });
+		
+		bool recordedBarrier = false;
+		bool budgetReached = false; // stop moving, but the copies recorded so far still need the closing barrier
+		std::unordered_set<Buffer*> moved; // a buffer moved into a denser block must not be copied out of it again when that block's turn comes
+		for (Block *source : sources) {
+			if (budgetReached) break;
+			for (Buffer *buffer : buffers) {
+				if (!buffer->movable || buffer->allocation.block != source || moved.count(buffer)) continue;
+				if (stats.bytesMoved + buffer->size > maxBytesToMove) {
+					budgetReached = true;
+					break;
+				}
+				
+				VkMemoryRequirements requirements;
+				vkGetBufferMemoryRequirements(device, buffer->buffer, &requirements);
+				Allocation target{};
+				if (!tryAllocateFromDenserBlock(requirements, source, target)) continue;
+				
+				if (!recordedBarrier) {
+					// whatever last wrote these buffers must land before we read them
+					VkMemoryBarrier barrier{};
+					barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+					barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+					barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					recordedBarrier = true;
+				}
+				
+				VkBuffer copy = createBufferHandle(buffer->size, buffer->usage);
+				vkBindBufferMemory(device, copy, target.memory, target.offset);
+				VkBufferCopy region{0, 0, buffer->size};
+				vkCmdCopyBuffer(commandBuffer, buffer->buffer, copy, 1, &region);
+				
+				pendingMoves.push_back({buffer->buffer, buffer->allocation});
+				buffer->buffer = copy;
+				buffer->allocation = target;
+				moved.insert(buffer);
+				++stats.buffersMoved;
+				stats.bytesMoved += buffer->size;
+			}
+		}
+		
+		if (recordedBarrier) {
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+		return stats;
+	}
+	
+	uint32_t finishDefragmentation() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& move : pendingMoves) {
+			vkDestroyBuffer(device, move.oldBuffer, allocator);
+			freeLocked(move.oldAllocation);
+		}
+		pendingMoves.clear();
+		return releaseEmptyBlocks();
+	}
+	
+	Stats getStats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats stats{};
+		for (auto& block : blocks) {
+			stats.reservedBytes += block->size;
+			stats.requestedBytes += block->requestedBytes;
+			stats.allocationCount += block->allocationCount;
+			if (block->dedicated) {
+				++stats.dedicatedCount;
+				stats.usedBytes += block->size;
+				continue;
+			}
+			++stats.blockCount;
+			stats.usedBytes += block->usedBytes;
+			stats.freeBytes += block->size - block->usedBytes;
+			for (uint32_t order = block->maxOrder + 1 ; order-- > 0 ; ) {
+				if (!block->freeLists[order].empty()) {
+					stats.largestFreeRange = std::max(stats.largestFreeRange, nodeSize(order));
+					stats.contiguousFreeBytes += nodeSize(order);
+					break;
+				}
+			}
+		}
+		for (auto& arena : frameArenas) {
+			for (auto& chunk : arena.chunks) {
+				stats.frameArenaBytes += chunk.size;
+			}
+		}
+		return stats;
+	}
+	
+	void printStats(std::ostream& out) {
+		Stats stats = getStats();
+		out << "device memory: " << stats.blockCount << " blocks + " << stats.dedicatedCount << " dedicated, "
+			<< stats.allocationCount << " allocations, " << stats.requestedBytes << " / " << stats.reservedBytes << " bytes used ("
+			<< stats.utilization() * 100.0 << "%), fragmentation " << stats.fragmentation() * 100.0 << "%, frame arenas "
+			<< stats.frameArenaBytes << " bytes, " << memoryAllocationCount << " VkDeviceMemory objects\n";
+	}
+	
+private:
+	enum class ResourceKind { Linear, Optimal };
+	
+	static constexpr VkDeviceSize MIN_NODE_SIZE = 256;
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+	static constexpr VkDeviceSize FRAME_CHUNK_SIZE = 4ull * 1024 * 1024;
+	
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void *mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		ResourceKind kind = ResourceKind::Linear;
+		bool dedicated = false;
+		uint32_t maxOrder = 0; // size == MIN_NODE_SIZE << maxOrder
+		std::vector<std::set<VkDeviceSize>> freeLists; // free node offsets per order
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize requestedBytes = 0;
+		uint32_t allocationCount = 0;
+	};
+	
+	struct LinearChunk {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize offset = 0;
+		void *mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+	};
+	
+	struct FrameArena {
+		std::vector<LinearChunk> chunks;
+	};
+	
+	struct PendingMove {
+		VkBuffer oldBuffer;
+		Allocation oldAllocation;
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize bufferImageGranularity = 1;
+	uint32_t maxMemoryAllocationCount = 4096;
+	uint32_t memoryAllocationCount = 0;
+	
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::vector<FrameArena> frameArenas;
+	uint32_t currentFrame = 0;
+	std::set<Buffer*> buffers;
+	std::vector<PendingMove> pendingMoves;
+	
+	static VkDeviceSize nodeSize(uint32_t order) {
+		return MIN_NODE_SIZE << order;
+	}
+	
+	static uint32_t orderFor(VkDeviceSize size) {
+		uint32_t order = 0;
+		while (nodeSize(order) < size) ++order;
+		return order;
+	}
+	
+	static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+	
+	bool isHostVisible(uint32_t memoryTypeIndex) const {
+		return memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+	
+	// granularity only matters if linear and optimal resources could share a page
+	ResourceKind blockKindFor(ResourceKind kind) const {
+		return bufferImageGranularity > 1 ? kind : ResourceKind::Linear;
+	}
+	
+	VkBuffer createBufferHandle(VkDeviceSize size, VkBufferUsageFlags usage) {
+		VkBufferCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		createInfo.size = size;
+		createInfo.usage = usage;
+		createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &createInfo, allocator, &buffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create buffer");
+		}
+		return buffer;
+	}
+	
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void **mapped) {
+		if (memoryAllocationCount >= maxMemoryAllocationCount) {
+			throw std::runtime_error("maxMemoryAllocationCount reached");
+		}
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, allocator, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate device memory");
+		}
+		++memoryAllocationCount;
+		
+		*mapped = nullptr;
+		if (isHostVisible(memoryTypeIndex) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+			*mapped = nullptr;
+		}
+		return memory;
+	}
+	
+	void freeDeviceMemory(VkDeviceMemory memory) {
+		vkFreeMemory(device, memory, allocator); // implicitly unmaps
+		--memoryAllocationCount;
+	}
+	
+	// a quarter of the heap at most, so small heaps (integrated, lavapipe's host heap limits) still get several blocks
+	VkDeviceSize blockSizeFor(uint32_t memoryTypeIndex) const {
+		VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		VkDeviceSize size = DEFAULT_BLOCK_SIZE;
+		while (size > MIN_NODE_SIZE && size > heapSize / 4) size /= 2;
+		return size;
+	}
+	
+	Block* createBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size, bool dedicated) {
+		auto block = std::make_unique<Block>();
+		block->memoryTypeIndex = memoryTypeIndex;
+		block->kind = kind;
+		block->size = size;
+		block->dedicated = dedicated;
+		block->memory = allocateDeviceMemory(size, memoryTypeIndex, &block->mapped);
+		if (!dedicated) {
+			block->maxOrder = orderFor(size);
+			block->freeLists.resize(block->maxOrder + 1);
+			block->freeLists[block->maxOrder].insert(0);
+		}
+		blocks.push_back(std::move(block));
+		return blocks.back().get();
+	}
+	
+	// splits larger nodes down to the requested order; nodes are aligned to their own size within the block
+	bool buddyAllocate(Block& block, uint32_t order, VkDeviceSize& offset) {
+		if (order > block.maxOrder) return false;
+		uint32_t available = order;
+		while (available <= block.maxOrder && block.freeLists[available].empty()) ++available;
+		if (available > block.maxOrder) return false;
+		
+		offset = *block.freeLists[available].begin(); // lowest offset keeps allocations packed towards the front
+		block.freeLists[available].erase(block.freeLists[available].begin());
+		while (available > order) {
+			--available;
+			block.freeLists[available].insert(offset + nodeSize(available));
+		}
+		block.usedBytes += nodeSize(order);
+		return true;
+	}
+	
+	void buddyFree(Block& block, VkDeviceSize offset, uint32_t order) {
+		block.usedBytes -= nodeSize(order);
+		while (order < block.maxOrder) {
+			VkDeviceSize buddy = offset ^ nodeSize(order);
+			auto found = block.freeLists[order].find(buddy);
+			if (found == block.freeLists[order].end()) break;
+			block.freeLists[order].erase(found);
+			offset = std::min(offset, buddy);
+			++order;
+		}
+		block.freeLists[order].insert(offset);
+	}
+	
+	Allocation allocationIn(Block *block, VkDeviceSize offset, uint32_t order, VkDeviceSize size) {
+		Allocation allocation{};
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+		allocation.memoryTypeIndex = block->memoryTypeIndex;
+		allocation.block = block;
+		allocation.order = order;
+		block->requestedBytes += size;
+		++block->allocationCount;
+		return allocation;
+	}
+	
+	Allocation allocatePersistent(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceKind kind, Block *exclude) {
+		kind = blockKindFor(kind);
+		VkDeviceSize blockSize = blockSizeFor(memoryTypeIndex);
+		uint32_t order = orderFor(std::max(requirements.size, requirements.alignment));
+		
+		if (nodeSize(order) > blockSize / 2) {
+			// too big to share a block usefully, give it its own VkDeviceMemory
+			Block *block = createBlock(memoryTypeIndex, kind, requirements.size, true);
+			return allocationIn(block, 0, 0, requirements.size);
+		}
+		
+		for (auto& block : blocks) {
+			if (block.get() == exclude || block->dedicated || block->memoryTypeIndex != memoryTypeIndex || block->kind != kind) continue;
+			VkDeviceSize offset;
+			if (buddyAllocate(*block, order, offset)) {
+				return allocationIn(block.get(), offset, order, requirements.size);
+			}
+		}
+		
+		Block *block = createBlock(memoryTypeIndex, kind, blockSize, false);
+		VkDeviceSize offset = 0;
+		buddyAllocate(*block, order, offset);
+		return allocationIn(block, offset, order, requirements.size);
+	}
+	
+	bool tryAllocateFromDenserBlock(const VkMemoryRequirements& requirements, Block *source, Allocation& allocation) {
+		uint32_t order = orderFor(std::max(requirements.size, requirements.alignment));
+		for (auto& block : blocks) {
+			if (block.get() == source || block->dedicated || block->memoryTypeIndex != source->memoryTypeIndex || block->kind != source->kind) continue;
+			if (block->usedBytes < source->usedBytes) continue; // only ever pack towards fuller blocks
+			VkDeviceSize offset;
+			if (buddyAllocate(*block, order, offset)) {
+				allocation = allocationIn(block.get(), offset, order, requirements.size);
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	Allocation allocateFromFrameArena(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex) {
+		if (frameArenas.empty()) {
+			throw std::runtime_error("no frame arenas created");
+		}
+		FrameArena& arena = frameArenas[currentFrame];
+		for (auto& chunk : arena.chunks) {
+			if (chunk.memoryTypeIndex != memoryTypeIndex) continue;
+			VkDeviceSize offset = alignUp(chunk.offset, requirements.alignment);
+			if (offset + requirements.size <= chunk.size) {
+				chunk.offset = offset + requirements.size;
+				return frameAllocationIn(chunk, offset, requirements.size);
+			}
+		}
+		
+		LinearChunk chunk{};
+		chunk.memoryTypeIndex = memoryTypeIndex;
+		chunk.size = std::max(FRAME_CHUNK_SIZE, alignUp(requirements.size, FRAME_CHUNK_SIZE));
+		chunk.memory = allocateDeviceMemory(chunk.size, memoryTypeIndex, &chunk.mapped);
+		chunk.offset = requirements.size;
+		arena.chunks.push_back(chunk);
+		return frameAllocationIn(arena.chunks.back(), 0, requirements.size);
+	}
+	
+	Allocation frameAllocationIn(const LinearChunk& chunk, VkDeviceSize offset, VkDeviceSize size) {
+		Allocation allocation{};
+		allocation.memory = chunk.memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = chunk.mapped ? static_cast<char*>(chunk.mapped) + offset : nullptr;
+		allocation.memoryTypeIndex = chunk.memoryTypeIndex;
+		allocation.lifetime = Lifetime::Frame;
+		return allocation;
+	}
+	
+	void freeLocked(Allocation& allocation) {
+		if (allocation.lifetime == Lifetime::Frame || !allocation.block) {
+			allocation = {};
+			return; // frame allocations go away with resetFrameArena()
+		}
+		Block *block = allocation.block;
+		block->requestedBytes -= allocation.size;
+		--block->allocationCount;
+		if (block->dedicated) {
+			freeDeviceMemory(block->memory);
+			blocks.erase(std::find_if(blocks.begin(), blocks.end(), [block](const auto& owned) { return owned.get() == block; }));
+		} else {
+			buddyFree(*block, allocation.offset, allocation.order);
+		}
+		allocation = {};
+	}
+	
+	// keeps one empty block per memory type and kind around so churn doesn't hit vkAllocateMemory
+	uint32_t releaseEmptyBlocks() {
+		uint32_t released = 0;
+		std::set<std::pair<uint32_t, ResourceKind>> keptSpare;
+		for (auto it = blocks.begin() ; it != blocks.end() ; ) {
+			Block& block = **it;
+			if (block.allocationCount == 0 && !keptSpare.insert({block.memoryTypeIndex, block.kind}).second) {
+				freeDeviceMemory(block.memory);
+				it = blocks.erase(it);
+				++released;
+			} else {
+				++it;
+			}
+		}
+		return released;
+	}
+};
+
+
+enum class QueueRole : uint32_t { Graphics, Present, Transfer, Compute, Count };
+
+/* the device's queues by role. roles may share a VkQueue (e.g. graphics and present almost always do),
+   every submit goes through the lock of the VkQueue it lands on since queues need external synchronization.
+   resources with VK_SHARING_MODE_EXCLUSIVE that move between roles on different families need a release
+   barrier on the source queue and a matching acquire barrier on the destination queue, see OwnershipTransfer.
+   
+   every VkQueue counts its submissions on a timeline: submit() returns the value the queue reaches once that
+   submission is done, and CPU waits, resource retirement and other queues' waits are all phrased as values.
+   with VK_KHR_timeline_semaphore that's one timeline semaphore per queue. without it each submission gets a
+   pooled fence, and one that another queue may wait on also signals a pooled binary semaphore which the
+   first submission waiting on that value or a later one consumes */
+class DeviceQueues {
+public:
+	struct Assignment {
+		uint32_t family;
+		uint32_t index;
+	};
+	
+	// one buffer or image changing hands; leave the other handle VK_NULL_HANDLE
+	struct OwnershipTransfer {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = VK_WHOLE_SIZE;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageSubresourceRange subresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+		VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkAccessFlags srcAccessMask = 0;             // how the source queue last wrote it
+		VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkAccessFlags dstAccessMask = 0;             // how the destination queue will use it
+		VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	};
+	
+	// work on role's queue up to value has to finish before stage of the submission
+	struct Wait {
+		QueueRole role;
+		uint64_t value;
+		VkPipelineStageFlags stage;
+	};
+	
+	struct Submission {
+		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<Wait> waits;
+		std::vector<VkSemaphore> waitSemaphores;     // binary, e.g. the swapchain image's acquire
+		std::vector<VkPipelineStageFlags> waitStages;
+		std::vector<VkSemaphore> signalSemaphores;   // binary, e.g. for present
+		std::optional<QueueRole> waitedOnBy;         // the role that will wait on its value, only matters without timelines
+	};
+	
+	/* useTimelines: VK_KHR_timeline_semaphore is enabled on device with its timelineSemaphore feature,
+	   falls back to fences if the entry points don't turn up anyway */
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, const std::array<Assignment, static_cast<size_t>(QueueRole::Count)>& assignments, bool useTimelines) {
+		this->device = device;
+		this->allocator = allocator;
+		slots.clear();
+		for (size_t role = 0 ; role < assignments.size() ; ++role) {
+			const Assignment& assignment = assignments[role];
+			auto existing = std::find_if(slots.begin(), slots.end(), [&](const auto& slot) {
+				return slot->family == assignment.family && slot->index == assignment.index;
+			});
+			if (existing == slots.end()) {
+				auto slot = std::make_unique<Slot>();
+				slot->family = assignment.family;
+				slot->index = assignment.index;
+				vkGetDeviceQueue(device, assignment.family, assignment.index, &slot->queue);
+				slots.push_back(std::move(slot));
+				existing = slots.end() - 1;
+			}
+			roles[role] = existing->get();
+		}
+		
+		timelines = false;
+		if (useTimelines) {
+			getSemaphoreCounterValueKHR = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR"));
+			waitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+			timelines = getSemaphoreCounterValueKHR != nullptr && waitSemaphoresKHR != nullptr;
+		}
+		if (timelines) {
+			VkSemaphoreTypeCreateInfoKHR typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+			typeInfo.initialValue = 0;
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphoreInfo.pNext = &typeInfo;
+			for (auto& slot : slots) {
+				if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &slot->timeline) != VK_SUCCESS) {
+					throw std::runtime_error("failed to create queue timeline semaphore");
+				}
+			}
+		}
+	}
+	
+	// the device must be idle
+	void destroy() {
+		if (device == VK_NULL_HANDLE) return;
+		for (auto& slot : slots) {
+			vkDestroySemaphore(device, slot->timeline, allocator);
+			for (const auto& [value, fence] : slot->pendingFences) vkDestroyFence(device, fence, allocator);
+			for (const auto& [value, semaphore] : slot->unwaitedSignals) vkDestroySemaphore(device, semaphore, allocator);
+			for (const auto& [value, semaphore] : slot->consumedSignals) vkDestroySemaphore(device, semaphore, allocator);
+		}
+		for (VkFence fence : freeFences) vkDestroyFence(device, fence, allocator);
+		for (VkSemaphore semaphore : freeSemaphores) vkDestroySemaphore(device, semaphore, allocator);
+		freeFences.clear();
+		freeSemaphores.clear();
+		slots.clear();
+		device = VK_NULL_HANDLE;
+	}
+	
+	VkQueue queue(QueueRole role) const { return roles[static_cast<size_t>(role)]->queue; }
+	uint32_t family(QueueRole role) const { return roles[static_cast<size_t>(role)]->family; }
+	bool sharesQueue(QueueRole a, QueueRole b) const { return roles[static_cast<size_t>(a)] == roles[static_cast<size_t>(b)]; }
+	bool needsOwnershipTransfer(QueueRole src, QueueRole dst) const { return family(src) != family(dst); }
+	bool usesTimelines() const { return timelines; }
+	
+	// submits on role's queue, returns the value the queue's timeline reaches once the submission is done
+	uint64_t submit(QueueRole role, const Submission& submission) {
+		Slot& slot = *roles[static_cast<size_t>(role)];
+		std::lock_guard<std::mutex> lock(slot.mutex);
+		uint64_t value = slot.submitted + 1;
+		
+		std::vector<VkSemaphore> waitSemaphores = submission.waitSemaphores;
+		std::vector<VkPipelineStageFlags> waitStages = submission.waitStages;
+		std::vector<uint64_t> waitValues(waitSemaphores.size(), 0); // ignored for binary semaphores
+		std::vector<VkSemaphore> signalSemaphores = submission.signalSemaphores;
+		std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+		VkFence fence = VK_NULL_HANDLE;
+		if (timelines) {
+			for (const Wait& wait : submission.waits) {
+				Slot& source = *roles[static_cast<size_t>(wait.role)];
+				// same queue: submission order and the acquire barriers already cover it
+				if (&source == &slot || wait.value <= source.completed.load(std::memory_order_relaxed)) continue;
+				waitSemaphores.push_back(source.timeline);
+				waitStages.push_back(wait.stage);
+				waitValues.push_back(wait.value);
+			}
+			signalSemaphores.push_back(slot.timeline);
+			signalValues.push_back(value);
+		} else {
+			std::lock_guard<std::mutex> syncLock(syncMutex);
+			for (const Wait& wait : submission.waits) {
+				Slot& source = *roles[static_cast<size_t>(wait.role)];
+				if (&source == &slot) continue;
+				consumeSignals(source, wait, slot, value, waitSemaphores, waitStages);
+			}
+			waitValues.resize(waitSemaphores.size(), 0);
+			// a waiter on the same queue is ordered by submission already, a semaphore for it would never be waited on
+			if (submission.waitedOnBy && !sharesQueue(role, *submission.waitedOnBy)) {
+				VkSemaphore semaphore = takeSemaphore();
+				signalSemaphores.push_back(semaphore);
+				signalValues.push_back(0);
+				slot.unwaitedSignals.emplace_back(value, semaphore);
+			}
+			fence = takeFence();
+			slot.pendingFences.emplace_back(value, fence);
+		}
+		
+		VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+		
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = timelines ? &timelineInfo : nullptr;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		submitInfo.commandBufferCount = static_cast<uint32_t>(submission.commandBuffers.size());
+		submitInfo.pCommandBuffers = submission.commandBuffers.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+		submitInfo.pSignalSemaphores = signalSemaphores.data();
+		if (vkQueueSubmit(slot.queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit to queue");
+		}
+		slot.submitted = value;
+		return value;
+	}
+	
+	VkResult present(const VkPresentInfoKHR& presentInfo) {
+		Slot& slot = *roles[static_cast<size_t>(QueueRole::Present)];
+		std::lock_guard<std::mutex> lock(slot.mutex);
+		return vkQueuePresentKHR(slot.queue, &presentInfo);
+	}
+	
+	void waitIdle(QueueRole role) {
+		Slot& slot = *roles[static_cast<size_t>(role)];
+		std::lock_guard<std::mutex> lock(slot.mutex);
+		vkQueueWaitIdle(slot.queue);
+	}
+	
+	// everything submitted to role's queue up to the returned value is done, doesn't block
+	uint64_t completedValue(QueueRole role) {
+		Slot& slot = *roles[static_cast<size_t>(role)];
+		if (timelines) {
+			uint64_t value = 0;
+			// e.g. device lost: nothing about the GPU's progress is known, so nothing may be taken as done
+			if (getSemaphoreCounterValueKHR(device, slot.timeline, &value) != VK_SUCCESS) {
+				throw std::runtime_error("failed to read queue timeline value");
+			}
+			advance(slot, value);
+		} else {
+			std::lock_guard<std::mutex> syncLock(syncMutex);
+			poll(slot);
+		}
+		return slot.completed.load(std::memory_order_relaxed);
+	}
+	
+	bool reached(QueueRole role, uint64_t value) {
+		const Slot& slot = *roles[static_cast<size_t>(role)];
+		return value <= slot.completed.load(std::memory_order_relaxed) || value <= completedValue(role);
+	}
+	
+	// blocks until role's queue has reached value
+	void wait(QueueRole role, uint64_t value) {
+		Slot& slot = *roles[static_cast<size_t>(role)];
+		if (timelines) {
+			if (reached(role, value)) return;
+			VkSemaphoreWaitInfoKHR waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &slot.timeline;
+			waitInfo.pValues = &value;
+			if (waitSemaphoresKHR(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+				throw std::runtime_error("failed to wait for queue timeline value");
+			}
+			++hostWaits;
+			advance(slot, value);
+		} else {
+			std::lock_guard<std::mutex> syncLock(syncMutex);
+			waitLocked(slot, value);
+		}
+	}
+	
+	// release half, recorded at the end of the source queue's command buffer
+	void recordRelease(VkCommandBuffer commandBuffer, QueueRole src, QueueRole dst, const std::vector<OwnershipTransfer>& transfers) const {
+		recordBarriers(commandBuffer, src, dst, transfers, true);
+	}
+	
+	// acquire half, recorded at the start of the destination queue's command buffer
+	void recordAcquire(VkCommandBuffer commandBuffer, QueueRole src, QueueRole dst, const std::vector<OwnershipTransfer>& transfers) const {
+		recordBarriers(commandBuffer, src, dst, transfers, false);
+	}
+	
+	/* submits srcCommandBuffer (which must end with recordRelease) and dstCommandBuffer (which must start with
+	   recordAcquire), with the destination waiting on the source's value at dstWaitStage. when both roles share
+	   a family the barriers degrade to ordinary barriers. returns the destination's value */
+	uint64_t submitWithHandoff(QueueRole src, VkCommandBuffer srcCommandBuffer, QueueRole dst, VkCommandBuffer dstCommandBuffer,
+	                           VkPipelineStageFlags dstWaitStage) {
+		Submission srcSubmission;
+		srcSubmission.commandBuffers.push_back(srcCommandBuffer);
+		srcSubmission.waitedOnBy = dst;
+		uint64_t srcValue = submit(src, srcSubmission);
+		
+		Submission dstSubmission;
+		dstSubmission.commandBuffers.push_back(dstCommandBuffer);
+		dstSubmission.waits.push_back(Wait{src, srcValue, dstWaitStage});
+		return submit(dst, dstSubmission);
+	}
+	
+	void print(std::ostream& out) const {
+		static const char *roleNames[] = {"graphics", "present", "transfer", "compute"};
+		out << "queues:\n";
+		for (size_t role = 0 ; role < roles.size() ; ++role) {
+			out << '\t' << roleNames[role] << " : family " << roles[role]->family << ", queue " << roles[role]->index << '\n';
+		}
+		out << "\tsync : " << (timelines ? "timeline semaphores" : "fences and binary semaphores (no VK_KHR_timeline_semaphore)") << '\n';
+	}
+	
+	void printStats(std::ostream& out) {
+		uint64_t submissions = 0;
+		for (const auto& slot : slots) submissions += slot->submitted;
+		std::lock_guard<std::mutex> syncLock(syncMutex);
+		out << "queue sync: " << submissions << " submissions, " << hostWaits.load() << " blocking host waits, ";
+		if (timelines) {
+			out << slots.size() << " timeline semaphores\n";
+		} else {
+			out << createdFences << " fences and " << createdSemaphores << " semaphores created\n";
+		}
+	}
+	
+private:
+	struct Slot {
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t family = 0;
+		uint32_t index = 0;
+		std::mutex mutex;
+		uint64_t submitted = 0;                 // value of the last submission, under mutex
+		std::atomic<uint64_t> completed{0};     // as of the last poll or wait, only grows
+		VkSemaphore timeline = VK_NULL_HANDLE;
+		// without timelines, under syncMutex; all oldest first
+		std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+		std::deque<std::pair<uint64_t, VkSemaphore>> unwaitedSignals;  // by the value that signals them
+		std::deque<std::pair<uint64_t, VkSemaphore>> consumedSignals;  // by the value of this queue's submission that waited on them
+	};
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	std::vector<std::unique_ptr<Slot>> slots;
+	std::array<Slot*, static_cast<size_t>(QueueRole::Count)> roles{};
+	bool timelines = false;
+	PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValueKHR = nullptr;
+	PFN_vkWaitSemaphoresKHR waitSemaphoresKHR = nullptr;
+	std::mutex syncMutex; // the fallback's bookkeeping across all queues, taken after a queue's own mutex
+	std::vector<VkFence> freeFences;
+	std::vector<VkSemaphore> freeSemaphores;
+	uint32_t createdFences = 0;
+	uint32_t createdSemaphores = 0;
+	std::atomic<uint64_t> hostWaits{0};
+	
+	static void advance(Slot& slot, uint64_t value) {
+		uint64_t completed = slot.completed.load(std::memory_order_relaxed);
+		while (completed < value && !slot.completed.compare_exchange_weak(completed, value, std::memory_order_relaxed)) {}
+	}
+	
+	VkFence takeFence() {
+		if (!freeFences.empty()) {
+			VkFence fence = freeFences.back();
+			freeFences.pop_back();
+			return fence;
+		}
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkFence fence;
+		if (vkCreateFence(device, &fenceInfo, allocator, &fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create submission fence");
+		}
+		++createdFences;
+		return fence;
+	}
+	
+	VkSemaphore takeSemaphore() {
+		if (!freeSemaphores.empty()) {
+			VkSemaphore semaphore = freeSemaphores.back();
+			freeSemaphores.pop_back();
+			return semaphore;
+		}
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkSemaphore semaphore;
+		if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create submission semaphore");
+		}
+		++createdSemaphores;
+		return semaphore;
+	}
+	
+	// fences signal in submission order, so the first unsignaled one ends the walk
+	void poll(Slot& slot) {
+		while (!slot.pendingFences.empty()) {
+			VkResult status = vkGetFenceStatus(device, slot.pendingFences.front().second);
+			if (status == VK_NOT_READY) break;
+			if (status != VK_SUCCESS) {
+				throw std::runtime_error("failed to query submission fence");
+			}
+			auto [value, fence] = slot.pendingFences.front();
+			slot.pendingFences.pop_front();
+			vkResetFences(device, 1, &fence);
+			freeFences.push_back(fence);
+			advance(slot, value);
+		}
+		uint64_t completed = slot.completed.load(std::memory_order_relaxed);
+		while (!slot.consumedSignals.empty() && slot.consumedSignals.front().first <= completed) {
+			freeSemaphores.push_back(slot.consumedSignals.front().second);
+			slot.consumedSignals.pop_front();
+		}
+		// nobody needs to wait for these anymore, but a binary semaphore can't be signaled again before it's waited on
+		while (!slot.unwaitedSignals.empty() && slot.unwaitedSignals.front().first <= completed) {
+			vkDestroySemaphore(device, slot.unwaitedSignals.front().second, allocator);
+			slot.unwaitedSignals.pop_front();
+		}
+	}
+	
+	void waitLocked(Slot& slot, uint64_t value) {
+		poll(slot);
+		if (value <= slot.completed.load(std::memory_order_relaxed)) return;
+		auto pending = std::find_if(slot.pendingFences.begin(), slot.pendingFences.end(), [&](const auto& entry) { return entry.first >= value; });
+		if (pending == slot.pendingFences.end()) {
+			throw std::runtime_error("waiting for a queue value that was never submitted");
+		}
+		if (vkWaitForFences(device, 1, &pending->second, VK_TRUE, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to wait for submission fence");
+		}
+		++hostWaits;
+		poll(slot);
+	}
+	
+	/* the waiting submission (waiterValue on waiter) takes every unwaited semaphore of source up to the first one
+	   signaled at or after wait.value. if source's submission didn't signal one, or another queue already
+	   consumed it, there's nothing left to wait on on the GPU and the CPU waits instead */
+	void consumeSignals(Slot& source, const Wait& wait, Slot& waiter, uint64_t waiterValue,
+	                    std::vector<VkSemaphore>& semaphores, std::vector<VkPipelineStageFlags>& stages) {
+		poll(source);
+		if (wait.value <= source.completed.load(std::memory_order_relaxed)) return;
+		auto last = std::find_if(source.unwaitedSignals.begin(), source.unwaitedSignals.end(), [&](const auto& entry) { return entry.first >= wait.value; });
+		if (last == source.unwaitedSignals.end()) {
+			waitLocked(source, wait.value);
+			return;
+		}
+		++last;
+		for (auto it = source.unwaitedSignals.begin() ; it != last ; ++it) {
+			semaphores.push_back(it->second);
+			stages.push_back(wait.stage);
+			waiter.consumedSignals.emplace_back(waiterValue, it->second);
+		}
+		source.unwaitedSignals.erase(source.unwaitedSignals.begin(), last);
+	}
+	
+	void recordBarriers(VkCommandBuffer commandBuffer, QueueRole src, QueueRole dst, const std::vector<OwnershipTransfer>& transfers, bool release) const {
+		bool crossFamily = needsOwnershipTransfer(src, dst);
+		if (!crossFamily && release) return; // same family: one ordinary barrier on the acquire side is enough
+		
+		uint32_t srcFamily = crossFamily ? family(src) : VK_QUEUE_FAMILY_IGNORED;
+		uint32_t dstFamily = crossFamily ? family(dst) : VK_QUEUE_FAMILY_IGNORED;
+		
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		VkPipelineStageFlags srcStages = 0, dstStages = 0;
+		for (const auto& transfer : transfers) {
+			// the release ignores dst access and the acquire ignores src access, they're done by the other queue
+			VkAccessFlags srcAccess = (release || !crossFamily) ? transfer.srcAccessMask : 0;
+			VkAccessFlags dstAccess = (!release || !crossFamily) ? transfer.dstAccessMask : 0;
+			srcStages |= (release || !crossFamily) ? transfer.srcStageMask : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			dstStages |= release ? static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) : transfer.dstStageMask;
+			
+			if (transfer.buffer != VK_NULL_HANDLE) {
+				VkBufferMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = dstAccess;
+				barrier.srcQueueFamilyIndex = srcFamily;
+				barrier.dstQueueFamilyIndex = dstFamily;
+				barrier.buffer = transfer.buffer;
+				barrier.offset = transfer.offset;
+				barrier.size = transfer.size;
+				bufferBarriers.push_back(barrier);
+			} else if (transfer.image != VK_NULL_HANDLE) {
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = dstAccess;
+				barrier.oldLayout = transfer.oldLayout; // both halves must name the same transition
+				barrier.newLayout = transfer.newLayout;
+				barrier.srcQueueFamilyIndex = srcFamily;
+				barrier.dstQueueFamilyIndex = dstFamily;
+				barrier.image = transfer.image;
+				barrier.subresourceRange = transfer.subresourceRange;
+				imageBarriers.push_back(barrier);
+			}
+		}
+		if (bufferBarriers.empty() && imageBarriers.empty()) return;
+		
+		vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+};
+
+
+/* staging ring for streaming uploads. callers copy into one persistently mapped host-visible buffer, flush()
+   turns everything queued since the last flush into a single transfer-queue submission with one
+   vkCmdCopyBuffer per destination buffer and one vkCmdCopyBufferToImage per destination image. ring space
+   comes back once the transfer queue's timeline passes the batch's value, nothing waits per upload. the
+   graphics queue picks the batches up with the wait and acquire barriers from takeGraphicsWait()/recordAcquire() */
+class UploadRing {
+public:
+	struct Stats {
+		uint64_t uploads = 0;
+		uint64_t uploadedBytes = 0;
+		uint64_t batches = 0;
+		uint64_t copyCommands = 0;
+		uint64_t stalls = 0;           // times we had to wait on the GPU for ring space
+		double stallMilliseconds = 0.0;
+		VkDeviceSize peakUsedBytes = 0;
+	};
+	
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, DeviceMemoryAllocator& memoryAllocator, DeviceQueues& queues, VkDeviceSize capacity, uint32_t batchCount) {
+		this->device = device;
+		this->allocator = allocator;
+		this->memoryAllocator = &memoryAllocator;
+		this->queues = &queues;
+		this->capacity = capacity;
+		
+		staging = memoryAllocator.createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		mapped = static_cast<char*>(staging->allocation.mapped);
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queues.family(QueueRole::Transfer);
+		if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upload command pool");
+		}
+		
+		batches.resize(batchCount);
+		for (auto& batch : batches) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create upload batch");
+			}
+		}
+	}
+	
+	void destroy() {
+		if (device == VK_NULL_HANDLE) return;
+		queues->wait(QueueRole::Transfer, lastFlushed);
+		batches.clear();
+		vkDestroyCommandPool(device, commandPool, allocator);
+		memoryAllocator->destroyBuffer(staging);
+		staging = nullptr;
+		device = VK_NULL_HANDLE;
+	}
+	
+	/* queues size bytes for dst at dstOffset. dstAccessMask/dstStageMask describe the first graphics-queue use,
+	   the acquire barrier makes the data visible to exactly that */
+	void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size,
+	                  VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) {
+		VkDeviceSize offset = reserve(size, 4); // vkCmdCopyBuffer has no alignment rule, but keep memcpy and the DMA engine happy
+		std::memcpy(mapped + offset, data, size);
+		
+		auto& copies = pending.bufferCopies[dst];
+		if (!copies.empty() && copies.back().srcOffset + copies.back().size == offset && copies.back().dstOffset + copies.back().size == dstOffset) {
+			copies.back().size += size; // adjacent in both buffers, e.g. a mesh streamed in pieces
+		} else {
+			copies.push_back(VkBufferCopy{offset, dstOffset, size});
+		}
+		
+		DeviceQueues::OwnershipTransfer transfer{};
+		transfer.buffer = dst;
+		transfer.offset = dstOffset;
+		transfer.size = size;
+		transfer.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		transfer.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		transfer.dstAccessMask = dstAccessMask;
+		transfer.dstStageMask = dstStageMask;
+		pending.transfers.push_back(transfer);
+		
+		++stats.uploads;
+		stats.uploadedBytes += size;
+	}
+	
+	/* uploads one subresource region of dst. the touched mip levels/layers are discarded and end up in
+	   finalLayout. texelBlockSize is the format's block size in bytes, the copy source must be aligned to it */
+	void uploadImage(VkImage dst, const VkBufferImageCopy& region, const void *data, VkDeviceSize size, VkDeviceSize texelBlockSize,
+	                 VkImageLayout finalLayout, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask) {
+		VkDeviceSize offset = reserve(size, std::max<VkDeviceSize>(texelBlockSize, 4));
+		std::memcpy(mapped + offset, data, size);
+		
+		VkBufferImageCopy copy = region;
+		copy.bufferOffset = offset;
+		pending.imageCopies[dst].push_back(copy);
+		
+		DeviceQueues::OwnershipTransfer transfer{};
+		transfer.image = dst;
+		transfer.subresourceRange = {region.imageSubresource.aspectMask, region.imageSubresource.mipLevel, 1,
+		                             region.imageSubresource.baseArrayLayer, region.imageSubresource.layerCount};
+		transfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		transfer.newLayout = finalLayout;
+		transfer.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		transfer.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		transfer.dstAccessMask = dstAccessMask;
+		transfer.dstStageMask = dstStageMask;
+		pending.transfers.push_back(transfer);
+		
+		++stats.uploads;
+		stats.uploadedBytes += size;
+	}
+	
+	bool hasPendingUploads() const { return !pending.transfers.empty(); }
+	
+	// submits everything queued since the last flush as one batch on the transfer queue
+	void flush() {
+		if (!hasPendingUploads()) return;
+		
+		Batch& batch = batches[nextBatch];
+		waitForBatch(batch); // only blocks if uploads outran the GPU by a whole ring of batches
+		nextBatch = (nextBatch + 1) % batches.size();
+		
+		vkResetCommandBuffer(batch.commandBuffer, 0);
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+		
+		// images need TRANSFER_DST_OPTIMAL before the copy, the previous contents of the region are dropped
+		std::vector<VkImageMemoryBarrier> toTransferDst;
+		for (const auto& transfer : pending.transfers) {
+			if (transfer.image == VK_NULL_HANDLE) continue;
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = transfer.image;
+			barrier.subresourceRange = transfer.subresourceRange;
+			toTransferDst.push_back(barrier);
+		}
+		if (!toTransferDst.empty()) {
+			vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransferDst.size()), toTransferDst.data());
+		}
+		
+		for (const auto& [buffer, copies] : pending.bufferCopies) {
+			vkCmdCopyBuffer(batch.commandBuffer, staging->buffer, buffer, static_cast<uint32_t>(copies.size()), copies.data());
+			++stats.copyCommands;
+		}
+		for (const auto& [image, copies] : pending.imageCopies) {
+			vkCmdCopyBufferToImage(batch.commandBuffer, staging->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(copies.size()), copies.data());
+			++stats.copyCommands;
+		}
+		queues->recordRelease(batch.commandBuffer, QueueRole::Transfer, QueueRole::Graphics, pending.transfers);
+		
+		if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record upload batch");
+		}
+		
+		DeviceQueues::Submission submission;
+		submission.commandBuffers.push_back(batch.commandBuffer);
+		submission.waitedOnBy = QueueRole::Graphics;
+		batch.value = queues->submit(QueueRole::Transfer, submission);
+		lastFlushed = batch.value;
+		
+		batch.ringBytes = pending.ringBytes;
+		inFlight.push_back(&batch);
+		acquires.insert(acquires.end(), pending.transfers.begin(), pending.transfers.end());
+		pending = PendingBatch{};
+		++stats.batches;
+	}
+	
+	// what the next graphics submission has to wait on: every batch flushed since the last call, i.e. the newest of them
+	void takeGraphicsWait(std::vector<DeviceQueues::Wait>& waits) {
+		if (lastFlushed == lastTaken) return;
+		waits.push_back(DeviceQueues::Wait{QueueRole::Transfer, lastFlushed, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT}); // narrowed by the acquire barriers' own stage masks
+		lastTaken = lastFlushed;
+	}
+	
+	// transfer queue value of the latest flush, everything uploaded before it is in place once that's reached
+	uint64_t flushedValue() const { return lastFlushed; }
+	
+	// acquire half of the ownership transfer, goes at the start of the graphics command buffer that waits on takeGraphicsWait()
+	void recordAcquire(VkCommandBuffer commandBuffer) {
+		if (acquires.empty()) return;
+		queues->recordAcquire(commandBuffer, QueueRole::Transfer, QueueRole::Graphics, acquires);
+		acquires.clear();
+	}
+	
+	// hands finished batches' ring space back without blocking
+	void reclaim() {
+		while (!inFlight.empty() && queues->reached(QueueRole::Transfer, inFlight.front()->value)) {
+			retire(*inFlight.front());
+		}
+	}
+	
+	const Stats& getStats() const { return stats; }
+	
+	void printStats(std::ostream& out) const {
+		out << "upload ring: " << stats.uploads << " uploads, " << stats.uploadedBytes / 1024 << " KiB in " << stats.batches
+		    << " batches (" << stats.copyCommands << " copy commands), peak " << stats.peakUsedBytes / 1024 << " / " << capacity / 1024
+		    << " KiB, " << stats.stalls << " stalls (" << std::fixed << std::setprecision(2) << stats.stallMilliseconds << " ms)\n";
+	}
+	
+private:
+	struct Batch {
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		uint64_t value = 0;          // transfer queue value of its submission, 0 once retired
+		VkDeviceSize ringBytes = 0;  // ring space to hand back once the value is reached, including wrap padding
+	};
+	
+	struct PendingBatch {
+		std::map<VkBuffer, std::vector<VkBufferCopy>> bufferCopies;
+		std::map<VkImage, std::vector<VkBufferImageCopy>> imageCopies;
+		std::vector<DeviceQueues::OwnershipTransfer> transfers;
+		VkDeviceSize ringBytes = 0;
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	DeviceMemoryAllocator *memoryAllocator = nullptr;
+	DeviceQueues *queues = nullptr;
+	DeviceMemoryAllocator::Buffer *staging = nullptr;
+	char *mapped = nullptr;
+	VkDeviceSize capacity = 0;
+	VkDeviceSize head = 0;  // next free byte, the oldest in-flight batch's bytes start usedBytes before it (modulo capacity)
+	VkDeviceSize usedBytes = 0;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	std::vector<Batch> batches;
+	size_t nextBatch = 0;
+	std::deque<Batch*> inFlight; // oldest first, same order as their bytes in the ring
+	uint64_t lastFlushed = 0;
+	uint64_t lastTaken = 0;      // lastFlushed as of the last takeGraphicsWait()
+	PendingBatch pending;
+	std::vector<DeviceQueues::OwnershipTransfer> acquires;
+	Stats stats;
+	
+	// contiguous space for size bytes, wrapping to the start of the ring when the tail end is too short
+	VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment) {
+		if (size > capacity) {
+			throw std::runtime_error("upload larger than the upload ring");
+		}
+		reclaim();
+		for (;;) {
+			VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+			VkDeviceSize needed = offset + size - head;
+			if (offset + size > capacity) {
+				offset = 0;
+				needed = capacity - head + size;
+			}
+			if (usedBytes + needed <= capacity) {
+				head = offset + size;
+				usedBytes += needed;
+				pending.ringBytes += needed;
+				stats.peakUsedBytes = std::max(stats.peakUsedBytes, usedBytes);
+				return offset;
+			}
+			
+			// out of space: wait for the oldest batch, then our own queued uploads, and once the ring is empty start over at 0
+			if (!inFlight.empty()) {
+				waitForBatch(*inFlight.front());
+			} else if (hasPendingUploads()) {
+				flush();
+			} else {
+				head = 0;
+			}
+		}
+	}
+	
+	void waitForBatch(Batch& batch) {
+		if (batch.value == 0) return;
+		if (!queues->reached(QueueRole::Transfer, batch.value)) {
+			auto start = std::chrono::steady_clock::now();
+			queues->wait(QueueRole::Transfer, batch.value);
+			stats.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			++stats.stalls;
+		}
+		// everything older finished before it, they went through the same queue
+		while (!inFlight.empty()) {
+			Batch *oldest = inFlight.front();
+			retire(*oldest);
+			if (oldest == &batch) break;
+		}
+	}
+	
+	void retire(Batch& batch) {
+		usedBytes -= batch.ringBytes;
+		batch.ringBytes = 0;
+		batch.value = 0;
+		inFlight.pop_front();
+		if (usedBytes == 0 && pending.ringBytes == 0) head = 0;
+	}
+};
+
+
+/* one global descriptor set with large partially bound arrays of textures and storage buffers, indexed
+   from shaders by a per-draw index instead of binding sets per draw. needs VK_EXT_descriptor_indexing.
+   slots are written with update-after-bind, so registering never waits for frames in flight; a released
+   slot is only handed out again once the frames that could still read it have finished */
+class BindlessTable {
+public:
+	static constexpr uint32_t TEXTURE_BINDING = 0;
+	static constexpr uint32_t BUFFER_BINDING = 1;
+	
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, uint32_t maxTextures, uint32_t maxBuffers) {
+		this->device = device;
+		this->allocator = allocator;
+		textureSlots.init(maxTextures);
+		bufferSlots.init(maxBuffers);
+		
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = TEXTURE_BINDING;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = maxTextures;
+		bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+		bindings[1].binding = BUFFER_BINDING;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = maxBuffers;
+		bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+		
+		VkDescriptorBindingFlags bindingFlags[2];
+		bindingFlags[0] = bindingFlags[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		                                  | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+		flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flagsInfo.bindingCount = 2;
+		flagsInfo.pBindingFlags = bindingFlags;
+		
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &flagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 2;
+		layoutInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &layout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create bindless descriptor set layout");
+		}
+		
+		VkDescriptorPoolSize sizes[] = {
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxTextures},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxBuffers},
+		};
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = sizes;
+		if (vkCreateDescriptorPool(device, &poolInfo, allocator, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create bindless descriptor pool");
+		}
+		
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate bindless descriptor set");
+		}
+	}
+	
+	void destroy() {
+		if (device == VK_NULL_HANDLE) return;
+		vkDestroyDescriptorPool(device, pool, allocator);
+		vkDestroyDescriptorSetLayout(device, layout, allocator);
+		device = VK_NULL_HANDLE;
+	}
+	
+	VkDescriptorSetLayout getLayout() const { return layout; }
+	VkDescriptorSet getSet() const { return set; }
+	
+	// the index shaders use to reach this texture
+	uint32_t registerTexture(VkImageView imageView, VkSampler sampler, VkImageLayout layout) {
+		uint32_t index = textureSlots.acquire();
+		VkDescriptorImageInfo imageInfo{sampler, imageView, layout};
+		write(TEXTURE_BINDING, index, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &imageInfo, nullptr);
+		return index;
+	}
+	
+	uint32_t registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+		uint32_t index = bufferSlots.acquire();
+		VkDescriptorBufferInfo bufferInfo{buffer, offset, range};
+		write(BUFFER_BINDING, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &bufferInfo);
+		return index;
+	}
+	
+	// frameNumber is the last frame that may use the slot, it becomes reusable once that frame completed
+	void releaseTexture(uint32_t index, uint64_t frameNumber) { textureSlots.release(index, frameNumber); }
+	void releaseBuffer(uint32_t index, uint64_t frameNumber) { bufferSlots.release(index, frameNumber); }
+	
+	// every frame before framesCompleted has finished on the GPU
+	void beginFrame(uint64_t framesCompleted) {
+		textureSlots.recycle(framesCompleted);
+		bufferSlots.recycle(framesCompleted);
+	}
+	
+private:
+	struct SlotAllocator {
+		uint32_t capacity = 0;
+		uint32_t next = 0; // slots at and above this were never handed out
+		std::vector<uint32_t> free;
+		std::deque<std::pair<uint64_t, uint32_t>> retired; // (frame number, slot), in release order
+		
+		void init(uint32_t capacity) { this->capacity = capacity; }
+		
+		uint32_t acquire() {
+			if (!free.empty()) {
+				uint32_t index = free.back();
+				free.pop_back();
+				return index;
+			}
+			if (next == capacity) {
+				throw std::runtime_error("bindless table is full");
+			}
+			return next++;
+		}
+		
+		void release(uint32_t index, uint64_t frameNumber) { retired.emplace_back(frameNumber, index); }
+		
+		void recycle(uint64_t framesCompleted) {
+			while (!retired.empty() && retired.front().first < framesCompleted) {
+				free.push_back(retired.front().second);
+				retired.pop_front();
+			}
+		}
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	SlotAllocator textureSlots;
+	SlotAllocator bufferSlots;
+	
+	void write(uint32_t binding, uint32_t index, VkDescriptorType type, const VkDescriptorImageInfo *imageInfo, const VkDescriptorBufferInfo *bufferInfo) {
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = binding;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = type;
+		write.pImageInfo = imageInfo;
+		write.pBufferInfo = bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+};
+
+
+/* streams textures that together don't fit in device memory. every texture is first made resident at its
+   coarse mip tail, request() asks for finer mips on demand. files are read, decoded and mipmapped on loader
+   threads; the finished levels are uploaded on the render thread into a new image holding base mip..last, which
+   replaces the old one once no frame in flight can use it anymore. when the next load would not fit the budget,
+   the least recently requested textures drop back to their tail, which is kept on the CPU for that.
+   the budget comes from VK_EXT_memory_budget when enabled (live heap usage, other processes included), else from
+   the device-local heap size and what our own allocator has reserved */
+class TextureStreamer {
+public:
+	static constexpr uint32_t TAIL_SIZE = 64;              // mips this size and smaller are loaded first and never evicted
+	static constexpr uint32_t LOADER_THREADS = 2;
+	static constexpr uint32_t BUDGET_QUERY_INTERVAL = 30;  // frames, the budget is re-read at least this often
+	static constexpr double BUDGET_HEADROOM = 0.9;         // of the heap budget, leaves room for everything else
+	static constexpr uint32_t REJECT_BACKOFF = 120;        // frames a rejected load isn't retried for unless room was freed
+	
+	struct Stats {
+		uint64_t loads = 0;
+		uint64_t uploadedBytes = 0;
+		uint64_t evictions = 0;
+		uint64_t rejected = 0;    // loads that didn't fit even after evicting everything idle
+		VkDeviceSize peakResidentBytes = 0;
+		VkDeviceSize budgetBytes = 0; // the last one we computed
+	};
+	
+	/* getMemoryProperties2 only when VK_EXT_memory_budget is enabled, nullptr falls back to heap sizes.
+	   bindless may be nullptr, textures then have no bindless index. maxBytes caps the textures on top of the budget */
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, const VkAllocationCallbacks *allocator, DeviceMemoryAllocator& memoryAllocator,
+	          UploadRing& uploadRing, VkDeviceSize maxUploadBytes, BindlessTable *bindless,
+	          PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2, VkDeviceSize maxBytes) {
+		this->physicalDevice = physicalDevice;
+		this->device = device;
+		this->allocator = allocator;
+		this->memoryAllocator = &memoryAllocator;
+		this->uploadRing = &uploadRing;
+		this->maxUploadBytes = maxUploadBytes;
+		this->bindless = bindless;
+		this->getMemoryProperties2 = getMemoryProperties2;
+		this->maxBytes = maxBytes;
+		
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE; // each image only holds the resident mips, its views start at the finest of them
+		if (vkCreateSampler(device, &samplerInfo, allocator, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture streaming sampler");
+		}
+		
+		stopping = false;
+		for (uint32_t i = 0 ; i < LOADER_THREADS ; ++i) {
+			loaders.emplace_back([this] { loaderLoop(); });
+		}
+	}
+	
+	// the device must be idle
+	void destroy() {
+		if (device == VK_NULL_HANDLE) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& loader : loaders) {
+			loader.join();
+		}
+		loaders.clear();
+		for (auto& texture : textures) {
+			destroyResidency(texture.resident);
+		}
+		for (auto& retired : retiredResidencies) {
+			destroyResidency(retired.second);
+		}
+		retiredResidencies.clear();
+		textures.clear();
+		vkDestroySampler(device, sampler, allocator);
+		device = VK_NULL_HANDLE;
+	}
+	
+	// a PPM (P6, 8 bits) file, its tail is queued for loading right away
+	uint32_t addTexture(const std::string& path) {
+		uint32_t handle = static_cast<uint32_t>(textures.size());
+		textures.emplace_back();
+		textures.back().path = path;
+		queueLoad(handle, TAIL_ONLY);
+		return handle;
+	}
+	
+	/* the texture is used this frame and wants mips from mip on. mips the upload ring can't take
+	   in one piece are not streamed, the finest resident mip stays coarser then */
+	void request(uint32_t handle, uint32_t mip, uint64_t frameNumber) {
+		Texture& texture = textures[handle];
+		texture.lastUsedFrame = frameNumber;
+		if (texture.mipCount == 0 || texture.loading) return; // tail not there yet, or already loading something
+		mip = std::clamp(mip, texture.finestStreamableMip, texture.tailMip);
+		// under budget pressure the same load would be read, decoded and thrown away again every frame
+		if (texture.rejected && mip <= texture.rejectedMip && frameNumber < texture.rejectedFrame + REJECT_BACKOFF && freeRoom() <= texture.rejectedRoom) return;
+		if (mip < texture.residentMip) {
+			queueLoad(handle, mip);
+		}
+	}
+	
+	// finest resident mip, mipCount() (nothing resident) until the tail has arrived
+	uint32_t residentMip(uint32_t handle) const { return textures[handle].residentMip; }
+	uint32_t mipCount(uint32_t handle) const { return textures[handle].mipCount; }
+	// changes whenever the residency does, UINT32_MAX while nothing is resident or without a bindless table
+	uint32_t bindlessIndex(uint32_t handle) const { return textures[handle].resident.bindlessIndex; }
+	uint32_t textureCount() const { return static_cast<uint32_t>(textures.size()); }
+	
+	/* on the render thread before the frame's uploads are flushed. uploads what the loaders finished, evicts
+	   to make room for it and destroys images the frames before framesCompleted were the last to use */
+	void update(uint64_t frameNumber, uint64_t framesCompleted) {
+		while (!retiredResidencies.empty() && retiredResidencies.front().first < framesCompleted) {
+			destroyResidency(retiredResidencies.front().second);
+			retiredResidencies.pop_front();
+		}
+		
+		std::deque<LoadResult> finished;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.swap(results);
+		}
+		if (!finished.empty() || frameNumber >= lastBudgetQuery + BUDGET_QUERY_INTERVAL) {
+			stats.budgetBytes = queryBudget();
+			lastBudgetQuery = frameNumber;
+		}
+		
+		for (auto& result : finished) {
+			Texture& texture = textures[result.handle];
+			texture.loading = false;
+			if (!result.error.empty()) {
+				if (texture.mipCount == 0) std::cerr << "texture streaming: " << result.error << '\n';
+				continue;
+			}
+			if (texture.mipCount == 0) {
+				texture.mipCount = result.mipCount;
+				texture.tailMip = result.tailMip;
+				texture.residentMip = result.mipCount;
+				texture.finestStreamableMip = result.finestStreamableMip;
+				texture.width = result.width;
+				texture.height = result.height;
+				texture.tail.assign(result.levels.end() - (result.mipCount - result.tailMip), result.levels.end());
+			}
+			if (result.baseMip >= texture.residentMip) continue; // evicted and reloaded in between, or nothing new
+			
+			VkDeviceSize incoming = levelBytes(result.levels);
+			VkDeviceSize needed = incoming > texture.resident.bytes ? incoming - texture.resident.bytes : 0;
+			if (!makeRoom(needed, frameNumber, result.handle) && texture.resident.image.image != VK_NULL_HANDLE) {
+				++stats.rejected;
+				texture.rejected = true; // stays at what it has, asked for again once there's room or after a while
+				texture.rejectedMip = result.baseMip;
+				texture.rejectedFrame = frameNumber;
+				texture.rejectedRoom = freeRoom();
+				continue;
+			}
+			texture.rejected = false;
+			makeResident(result.handle, result.baseMip, result.levels, frameNumber);
+			++stats.loads;
+		}
+		
+		// the budget may have shrunk under us (another process), give back until we fit again
+		if (residentBytes > stats.budgetBytes) {
+			makeRoom(0, frameNumber, UINT32_MAX);
+		}
+	}
+	
+	Stats getStats() const { return stats; }
+	
+	void printStats(std::ostream& out) const {
+		if (textures.empty()) return;
+		uint32_t beyondTail = 0;
+		for (const auto& texture : textures) {
+			if (texture.residentMip < texture.tailMip) ++beyondTail;
+		}
+		out << "texture streaming: " << textures.size() << " textures, " << beyondTail << " resident beyond their tail, "
+		    << stats.loads << " loads (" << stats.uploadedBytes / 1048576 << " MiB), " << stats.evictions << " evictions, "
+		    << stats.rejected << " rejected, peak " << stats.peakResidentBytes / 1048576 << " MiB of a "
+		    << stats.budgetBytes / 1048576 << " MiB budget (" << (getMemoryProperties2 ? "VK_EXT_memory_budget" : "heap size") << ")\n";
+	}
+	
+private:
+	static constexpr uint32_t TAIL_ONLY = UINT32_MAX;
+	
+	// one image holding mips baseMip..mipCount-1 of a texture
+	struct Residency {
+		DeviceMemoryAllocator::Image image{};
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t bindlessIndex = UINT32_MAX;
+		VkDeviceSize bytes = 0;
+	};
+	
+	using Level = std::vector<uint8_t>; // tightly packed RGBA8
+	
+	struct Texture {
+		std::string path;
+		uint32_t width = 0, height = 0; // of mip 0
+		uint32_t mipCount = 0;          // 0 until the first load told us
+		uint32_t tailMip = 0;
+		uint32_t finestStreamableMip = 0;
+		uint32_t residentMip = 0;
+		std::vector<Level> tail;        // tailMip..mipCount-1, to rebuild the image from on eviction
+		Residency resident;
+		uint64_t lastUsedFrame = 0;
+		bool loading = false;
+		bool rejected = false;          // the last load didn't fit, requests for its mip or finer ones back off
+		uint32_t rejectedMip = 0;
+		uint64_t rejectedFrame = 0;
+		VkDeviceSize rejectedRoom = 0;  // freeRoom() back then
+	};
+	
+	struct LoadRequest {
+		uint32_t handle;
+		uint32_t baseMip; // TAIL_ONLY for the first load
+		std::string path; // a copy, textures may grow while the loaders work
+	};
+	
+	struct LoadResult {
+		uint32_t handle = 0;
+		uint32_t baseMip = 0;
+		uint32_t mipCount = 0;
+		uint32_t tailMip = 0;
+		uint32_t finestStreamableMip = 0;
+		uint32_t width = 0, height = 0;
+		std::vector<Level> levels; // baseMip..mipCount-1
+		std::string error;
+	};
+	
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	DeviceMemoryAllocator *memoryAllocator = nullptr;
+	UploadRing *uploadRing = nullptr;
+	BindlessTable *bindless = nullptr;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkDeviceSize maxUploadBytes = 0;
+	VkDeviceSize maxBytes = 0;
+	VkDeviceSize residentBytes = 0;
+	uint64_t lastBudgetQuery = 0;
+	std::vector<Texture> textures;
+	std::deque<std::pair<uint64_t, Residency>> retiredResidencies; // (last frame that may use it, residency)
+	Stats stats;
+	
+	// shared with the loader threads
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<LoadRequest> requests;
+	std::deque<LoadResult> results;
+	bool stopping = false;
+	std::vector<std::thread> loaders;
+	
+	static VkDeviceSize levelBytes(const std::vector<Level>& levels) {
+		VkDeviceSize bytes = 0;
+		for (const auto& level : levels) bytes += level.size();
+		return bytes;
+	}
+	
+	static uint32_t mipExtent(uint32_t extent, uint32_t mip) {
+		return std::max(extent >> mip, 1u);
+	}
+	
+	VkDeviceSize freeRoom() const {
+		return stats.budgetBytes > residentBytes ? stats.budgetBytes - residentBytes : 0;
+	}
+	
+	void queueLoad(uint32_t handle, uint32_t baseMip) {
+		textures[handle].loading = true;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			requests.push_back({handle, baseMip, textures[handle].path});
+		}
+		wake.notify_one();
+	}
+	
+	// device-local bytes textures may use right now, all resident ones included
+	VkDeviceSize queryBudget() {
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		if (getMemoryProperties2) {
+			VkPhysicalDeviceMemoryProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties2.pNext = &budget;
+			getMemoryProperties2(physicalDevice, &properties2);
+			memoryProperties = properties2.memoryProperties;
+		} else {
+			vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		}
+		
+		// the largest device-local heap is where the textures end up
+		uint32_t heap = 0;
+		for (uint32_t i = 0 ; i < memoryProperties.memoryHeapCount ; ++i) {
+			if ((memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+			    memoryProperties.memoryHeaps[i].size > memoryProperties.memoryHeaps[heap].size) {
+				heap = i;
+			}
+		}
+		VkDeviceSize heapBudget, heapUsage;
+		if (getMemoryProperties2) {
+			heapBudget = budget.heapBudget[heap];
+			heapUsage = budget.heapUsage[heap]; // includes our textures
+		} else {
+			heapBudget = memoryProperties.memoryHeaps[heap].size; // no idea what others use, so we only know about ours
+			heapUsage = memoryAllocator->getStats().reservedBytes;
+		}
+		auto limit = static_cast<VkDeviceSize>(heapBudget * BUDGET_HEADROOM);
+		VkDeviceSize available = limit > heapUsage ? limit - heapUsage : 0;
+		return std::min(maxBytes, residentBytes + available);
+	}
+	
+	/* evicts least recently requested textures (never one requested this frame, never below their tail, never keep)
+	   until needed more bytes fit the budget. returns whether they do */
+	bool makeRoom(VkDeviceSize needed, uint64_t frameNumber, uint32_t keep) {
+		while (residentBytes + needed > stats.budgetBytes) {
+			uint32_t victim = UINT32_MAX;
+			for (uint32_t i = 0 ; i < textures.size() ; ++i) {
+				const Texture& texture = textures[i];
+				if (i == keep || texture.residentMip >= texture.tailMip || texture.lastUsedFrame >= frameNumber) continue;
+				if (victim == UINT32_MAX || texture.lastUsedFrame < textures[victim].lastUsedFrame) victim = i;
+			}
+			if (victim == UINT32_MAX) return false;
+			makeResident(victim, textures[victim].tailMip, textures[victim].tail, frameNumber);
+			++stats.evictions;
+		}
+		return true;
+	}
+	
+	// replaces the texture's image with one holding levels (baseMip..mipCount-1), the old one is retired
+	void makeResident(uint32_t handle, uint32_t baseMip, const std::vector<Level>& levels, uint64_t frameNumber) {
+		Texture& texture = textures[handle];
+		uint32_t levelCount = texture.mipCount - baseMip;
+		
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+		imageInfo.extent = {mipExtent(texture.width, baseMip), mipExtent(texture.height, baseMip), 1};
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		
+		Residency residency{};
+		residency.image = memoryAllocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		residency.bytes = residency.image.allocation.size;
+		
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = residency.image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = imageInfo.format;
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+		if (vkCreateImageView(device, &viewInfo, allocator, &residency.view) != VK_SUCCESS) {
+			memoryAllocator->destroyImage(residency.image);
+			throw std::runtime_error("failed to create streamed texture view");
+		}
+		
+		for (uint32_t level = 0 ; level < levelCount ; ++level) {
+			VkBufferImageCopy region{};
+			region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+			region.imageExtent = {mipExtent(texture.width, baseMip + level), mipExtent(texture.height, baseMip + level), 1};
+			uploadRing->uploadImage(residency.image.image, region, levels[level].data(), levels[level].size(), 4,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			stats.uploadedBytes += levels[level].size();
+		}
+		if (bindless) {
+			residency.bindlessIndex = bindless->registerTexture(residency.view, sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+		
+		// frames up to this one may have been recorded with the old image
+		if (texture.resident.image.image != VK_NULL_HANDLE) {
+			if (bindless) bindless->releaseTexture(texture.resident.bindlessIndex, frameNumber);
+			residentBytes -= texture.resident.bytes;
+			retiredResidencies.emplace_back(frameNumber, texture.resident);
+		}
+		texture.resident = residency;
+		texture.residentMip = baseMip;
+		residentBytes += residency.bytes;
+		stats.peakResidentBytes = std::max(stats.peakResidentBytes, residentBytes);
+	}
+	
+	void destroyResidency(Residency& residency) {
+		if (residency.image.image == VK_NULL_HANDLE) return;
+		vkDestroyImageView(device, residency.view, allocator);
+		memoryAllocator->destroyImage(residency.image);
+		residency = {};
+	}
+	
+	void loaderLoop() {
+		for (;;) {
+			LoadRequest request;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this] { return stopping || !requests.empty(); });
+				if (stopping) return;
+				request = std::move(requests.front());
+				requests.pop_front();
+			}
+			LoadResult result = load(request);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				results.push_back(std::move(result));
+			}
+		}
+	}
+	
+	/* reads the file and builds mips baseMip..mipCount-1, coarser ones box-filtered from baseMip. baseMip itself is
+	   decoded straight from the rows it needs: up to mip 1 every texel of its 2x2 block, past that 2x2 texels spread
+	   over the block it covers, so a coarse-first load reads a fraction of the file instead of all of it */
+	LoadResult load(const LoadRequest& request) const {
+		const std::string& path = request.path;
+		LoadResult result{};
+		result.handle = request.handle;
+		
+		std::ifstream file(path, std::ios::binary);
+		std::string magic;
+		uint32_t width = 0, height = 0, maxValue = 0;
+		auto skipComments = [&] {
+			while (file >> std::ws && file.peek() == '#') file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		};
+		file >> magic;
+		skipComments(); file >> width;
+		skipComments(); file >> height;
+		skipComments(); file >> maxValue;
+		file.get(); // the single whitespace before the pixels
+		if (!file || magic != "P6" || maxValue != 255 || width == 0 || height == 0) {
+			result.error = "not an 8-bit binary PPM: " + path;
+			return result;
+		}
+		std::streamoff pixels = file.tellg();
+		file.seekg(0, std::ios::end);
+		if (!file || static_cast<uint64_t>(static_cast<std::streamoff>(file.tellg()) - pixels) < uint64_t{width} * height * 3) {
+			result.error = "truncated PPM: " + path;
+			return result;
+		}
+		
+		result.width = width;
+		result.height = height;
+		result.mipCount = 1;
+		while ((std::max(width, height) >> result.mipCount) != 0) ++result.mipCount;
+		result.tailMip = 0;
+		while (std::max(mipExtent(width, result.tailMip), mipExtent(height, result.tailMip)) > TAIL_SIZE) ++result.tailMip;
+		result.finestStreamableMip = 0;
+		while (result.finestStreamableMip < result.tailMip &&
+		       VkDeviceSize{mipExtent(width, result.finestStreamableMip)} * mipExtent(height, result.finestStreamableMip) * 4 > maxUploadBytes) {
+			++result.finestStreamableMip;
+		}
+		result.baseMip = request.baseMip == TAIL_ONLY ? result.tailMip : std::max(request.baseMip, result.finestStreamableMip);
+		
+		// the two source rows or columns sampled for texel i of baseMip
+		uint32_t factor = 1u << result.baseMip;
+		auto samples = [&](uint32_t i, uint32_t extent) {
+			uint64_t start = uint64_t{i} * factor;
+			return std::pair<uint32_t, uint32_t>{static_cast<uint32_t>(std::min<uint64_t>(start + factor / 4, extent - 1)),
+			                                     static_cast<uint32_t>(std::min<uint64_t>(start + uint64_t{factor} * 3 / 4, extent - 1))};
+		};
+		std::vector<uint8_t> rows[2] = {std::vector<uint8_t>(size_t{width} * 3), std::vector<uint8_t>(size_t{width} * 3)};
+		uint32_t loadedRows[2] = {UINT32_MAX, UINT32_MAX};
+		auto readRow = [&](uint32_t row, uint32_t slot) {
+			if (loadedRows[slot] == row) return true;
+			file.seekg(pixels + static_cast<std::streamoff>(uint64_t{row} * width * 3));
+			file.read(reinterpret_cast<char*>(rows[slot].data()), static_cast<std::streamsize>(rows[slot].size()));
+			loadedRows[slot] = row;
+			return static_cast<bool>(file);
+		};
+		
+		uint32_t baseWidth = mipExtent(width, result.baseMip), baseHeight = mipExtent(height, result.baseMip);
+		Level level(size_t{baseWidth} * baseHeight * 4);
+		for (uint32_t y = 0 ; y < baseHeight ; ++y) {
+			auto [y0, y1] = samples(y, height);
+			if (!readRow(y0, 0) || !readRow(y1, 1)) {
+				result.error = "truncated PPM: " + path;
+				return result;
+			}
+			for (uint32_t x = 0 ; x < baseWidth ; ++x) {
+				auto [x0, x1] = samples(x, width);
+				uint8_t *texel = &level[(size_t{y} * baseWidth + x) * 4];
+				for (uint32_t c = 0 ; c < 3 ; ++c) {
+					uint32_t sum = rows[0][size_t{x0} * 3 + c] + rows[0][size_t{x1} * 3 + c] + rows[1][size_t{x0} * 3 + c] + rows[1][size_t{x1} * 3 + c];
+					texel[c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+				texel[3] = 255;
+			}
+		}
+		
+		for (uint32_t mip = result.baseMip ; mip < result.mipCount ; ++mip) {
+			uint32_t levelWidth = mipExtent(width, mip), levelHeight = mipExtent(height, mip);
+			Level next;
+			if (mip + 1 < result.mipCount) {
+				// 2x2 box filter, an odd last row/column is folded into its neighbour
+				uint32_t nextWidth = mipExtent(width, mip + 1), nextHeight = mipExtent(height, mip + 1);
+				next.resize(size_t{nextWidth} * nextHeight * 4);
+				for (uint32_t y = 0 ; y < nextHeight ; ++y) {
+					for (uint32_t x = 0 ; x < nextWidth ; ++x) {
+						uint32_t x0 = std::min(x * 2, levelWidth - 1), x1 = std::min(x * 2 + 1, levelWidth - 1);
+						uint32_t y0 = std::min(y * 2, levelHeight - 1), y1 = std::min(y * 2 + 1, levelHeight - 1);
+						for (uint32_t c = 0 ; c < 4 ; ++c) {
+							uint32_t sum = level[(size_t{y0} * levelWidth + x0) * 4 + c] + level[(size_t{y0} * levelWidth + x1) * 4 + c]
+							             + level[(size_t{y1} * levelWidth + x0) * 4 + c] + level[(size_t{y1} * levelWidth + x1) * 4 + c];
+							next[(size_t{y} * nextWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+						}
+					}
+				}
+			}
+			result.levels.push_back(std::move(level));
+			level = std::move(next);
+		}
+		return result;
+	}
+};
+
+
+/* everything that tells two graphics pipelines apart. the name is only for the stats, 
+   variants that differ in nothing else are the same pipeline */
+struct PipelineVariant {
+	std::string name;
+	std::string vertexShader;   // SPIR-V file
+	std::string fragmentShader;
+	std::vector<std::pair<uint32_t, uint32_t>> specialization; // constant_id, 32-bit value, applied to both stages
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	bool meshVertices = false; // MeshVertex buffers instead of the triangle hardcoded in the vertex shader
+	
+	// FNV-1a
+	uint64_t hash() const {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto mix = [&](const void *data, size_t size) {
+			auto bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0 ; i < size ; ++i) {
+				hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+			}
+		};
+		mix(vertexShader.data(), vertexShader.size() + 1); // with the terminator so "ab"+"c" != "a"+"bc"
+		mix(fragmentShader.data(), fragmentShader.size() + 1);
+		for (const auto& [id, value] : specialization) {
+			mix(&id, sizeof(id));
+			mix(&value, sizeof(value));
+		}
+		mix(&topology, sizeof(topology));
+		mix(&cullMode, sizeof(cullMode));
+		mix(&meshVertices, sizeof(meshVertices));
+		return hash;
+	}
+	
+	bool operator==(const PipelineVariant& other) const {
+		return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader &&
+		       specialization == other.specialization && topology == other.topology && cullMode == other.cullMode &&
+		       meshVertices == other.meshVertices;
+	}
+};
+
+
+// whether a pipeline was served from the cache, only drivers with VK_EXT_pipeline_creation_feedback tell
+enum class CacheLookup { Unknown, Hit, Miss };
+
+
+/* compiles declared pipeline permutations on background threads so nothing is compiled on first use.
+   until a variant is ready get() hands out the fallback pipeline, a frame never waits for the compiler.
+   every worker compiles into its own VkPipelineCache seeded from the main one, they are merged back into
+   the main cache once the workers are joined */
+class PipelineManager {
+public:
+	/* builds one pipeline into the given cache and says whether the cache served it, VK_NULL_HANDLE or an
+	   exception on failure. called from worker threads */
+	using Compiler = std::function<VkPipeline(const PipelineVariant&, VkRenderPass, VkPipelineLayout, VkPipelineCache, CacheLookup&)>;
+	
+	// only reached with workers still running when initialization threw, the device may be gone by now
+	~PipelineManager() {
+		cancelled.store(true);
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+	
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, VkPipelineCache mainCache, Compiler compiler, uint32_t threadCount) {
+		this->device = device;
+		this->allocator = allocator;
+		this->mainCache = mainCache;
+		this->compiler = std::move(compiler);
+		this->threadCount = std::max(threadCount, 1u);
+	}
+	
+	// returns the index get() takes, declaring the same variant twice returns the first one's index
+	uint32_t declare(const PipelineVariant& variant) {
+		uint64_t hash = variant.hash();
+		auto range = indexByHash.equal_range(hash);
+		for (auto it = range.first ; it != range.second ; ++it) {
+			if (variants[it->second]->description == variant) return it->second;
+		}
+		uint32_t index = static_cast<uint32_t>(variants.size());
+		variants.push_back(std::make_unique<Variant>());
+		variants.back()->description = variant;
+		indexByHash.emplace(hash, index);
+		return index;
+	}
+	
+	// owned by the caller
+	void setFallback(VkPipeline pipeline) {
+		fallback.store(pipeline, std::memory_order_release);
+	}
+	
+	// starts compiling every declared variant that isn't built yet, returns right away
+	void build(VkRenderPass renderPass, VkPipelineLayout layout) {
+		join(); // variants declared since the last build
+		this->renderPass = renderPass;
+		this->layout = layout;
+		cancelled.store(false);
+		
+		pending.clear();
+		for (uint32_t i = 0 ; i < variants.size() ; ++i) {
+			if (variants[i]->pipeline.load(std::memory_order_relaxed) == VK_NULL_HANDLE && !variants[i]->failed) {
+				pending.push_back(i);
+			}
+		}
+		if (pending.empty()) return;
+		nextPending.store(0);
+		
+		size_t seedSize = 0;
+		std::vector<char> seed;
+		if (mainCache != VK_NULL_HANDLE && vkGetPipelineCacheData(device, mainCache, &seedSize, nullptr) == VK_SUCCESS) {
+			seed.resize(seedSize);
+			if (vkGetPipelineCacheData(device, mainCache, &seedSize, seed.data()) != VK_SUCCESS) seed.clear();
+		}
+		
+		uint32_t workerCount = std::min(threadCount, static_cast<uint32_t>(pending.size()));
+		for (uint32_t i = 0 ; i < workerCount ; ++i) {
+			VkPipelineCacheCreateInfo cacheInfo{};
+			cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			cacheInfo.initialDataSize = seed.size();
+			cacheInfo.pInitialData = seed.empty() ? nullptr : seed.data();
+			VkPipelineCache cache;
+			if (vkCreatePipelineCache(device, &cacheInfo, allocator, &cache) != VK_SUCCESS) {
+				cacheInfo.initialDataSize = 0;
+				cacheInfo.pInitialData = nullptr;
+				if (vkCreatePipelineCache(device, &cacheInfo, allocator, &cache) != VK_SUCCESS) {
+					break; // fewer workers, the ones we have still get through the list
+				}
+			}
+			workerCaches.push_back(cache);
+			workers.emplace_back([this, cache] { workerLoop(cache); });
+		}
+		if (workers.empty()) {
+			throw std::runtime_error("failed to create pipeline cache for the pipeline compile threads");
+		}
+	}
+	
+	/* the render pass or layout the variants were built against is going away. waits for the compiles in 
+	   flight (they reference the old objects), hands back every built pipeline for the caller to retire with them
+	   and starts over against the new ones */
+	std::vector<VkPipeline> invalidate(VkRenderPass renderPass, VkPipelineLayout layout) {
+		cancelled.store(true);
+		join();
+		std::vector<VkPipeline> retired;
+		for (auto& variant : variants) {
+			VkPipeline pipeline = variant->pipeline.exchange(VK_NULL_HANDLE);
+			if (pipeline != VK_NULL_HANDLE) retired.push_back(pipeline);
+			variant->failed = false;
+		}
+		build(renderPass, layout);
+		return retired;
+	}
+	
+	// thread safe, never blocks
+	VkPipeline get(uint32_t index) {
+		Variant& variant = *variants[index];
+		VkPipeline pipeline = variant.pipeline.load(std::memory_order_acquire);
+		if (pipeline != VK_NULL_HANDLE) {
+			variant.specializedUses.fetch_add(1, std::memory_order_relaxed);
+			return pipeline;
+		}
+		variant.fallbackUses.fetch_add(1, std::memory_order_relaxed);
+		return fallback.load(std::memory_order_acquire);
+	}
+	
+	bool ready(uint32_t index) const {
+		return variants[index]->pipeline.load(std::memory_order_acquire) != VK_NULL_HANDLE;
+	}
+	
+	// blocks until every declared variant is compiled or failed
+	void waitUntilBuilt() {
+		join();
+	}
+	
+	// waits for the workers and merges what they compiled into the main cache, so it gets saved with it
+	void destroy() {
+		cancelled.store(true);
+		join();
+		for (auto& variant : variants) {
+			VkPipeline pipeline = variant->pipeline.exchange(VK_NULL_HANDLE);
+			if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, pipeline, allocator);
+		}
+	}
+	
+	void printStats(std::ostream& out) const {
+		if (variants.empty()) return;
+		out << "pipeline variants: " << variants.size() << " on " << threadCount << " thread(s)\n";
+		for (const auto& variant : variants) {
+			uint64_t specialized = variant->specializedUses.load();
+			uint64_t total = specialized + variant->fallbackUses.load();
+			out << "  " << std::left << std::setw(20) << variant->description.name << std::right;
+			if (variant->failed) {
+				out << "failed: " << variant->error;
+			} else if (variant->compiles == 0) {
+				out << "not compiled";
+			} else {
+				out << std::fixed << std::setprecision(2) << variant->compileMilliseconds << " ms";
+				if (variant->cacheLookups != 0) {
+					out << ", " << variant->cacheHits << "/" << variant->cacheLookups << " cache hits";
+				}
+			}
+			if (total != 0) {
+				out << ", " << std::setprecision(1) << 100.0 * specialized / total << "% of " << total << " binds specialized";
+			}
+			out << '\n';
+		}
+	}
+	
+private:
+	struct Variant {
+		PipelineVariant description;
+		std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+		std::atomic<uint64_t> specializedUses{0};
+		std::atomic<uint64_t> fallbackUses{0};
+		// written by the one worker compiling it, read after the workers are joined
+		uint32_t compiles = 0;
+		uint32_t cacheLookups = 0; // compiles the driver gave cache feedback for
+		uint32_t cacheHits = 0;
+		double compileMilliseconds = 0.0; // of the last compile
+		bool failed = false;
+		std::string error;
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	VkPipelineCache mainCache = VK_NULL_HANDLE;
+	Compiler compiler;
+	uint32_t threadCount = 1;
+	std::vector<std::unique_ptr<Variant>> variants; // stable addresses, workers hold on to them
+	std::multimap<uint64_t, uint32_t> indexByHash;
+	std::atomic<VkPipeline> fallback{VK_NULL_HANDLE};
+	
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	std::vector<uint32_t> pending;
+	std::atomic<size_t> nextPending{0};
+	std::atomic<bool> cancelled{false};
+	std::vector<std::thread> workers;
+	std::vector<VkPipelineCache> workerCaches;
+	
+	void workerLoop(VkPipelineCache cache) {
+		while (!cancelled.load(std::memory_order_relaxed)) {
+			size_t slot = nextPending.fetch_add(1);
+			if (slot >= pending.size()) return;
+			Variant& variant = *variants[pending[slot]];
+			
+			auto start = std::chrono::steady_clock::now();
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			CacheLookup lookup = CacheLookup::Unknown;
+			try {
+				pipeline = compiler(variant.description, renderPass, layout, cache, lookup);
+				if (pipeline == VK_NULL_HANDLE) variant.error = "compiler returned no pipeline";
+			} catch (const std::exception& e) {
+				variant.error = e.what();
+			}
+			variant.compileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (pipeline == VK_NULL_HANDLE) {
+				variant.failed = true; // stays on the fallback, not retried until the next invalidate()
+				continue;
+			}
+			++variant.compiles;
+			if (lookup != CacheLookup::Unknown) ++variant.cacheLookups;
+			if (lookup == CacheLookup::Hit) ++variant.cacheHits;
+			variant.pipeline.store(pipeline, std::memory_order_release);
+		}
+	}
+	
+	void join() {
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+		if (!workerCaches.empty()) {
+			if (mainCache != VK_NULL_HANDLE) {
+				vkMergePipelineCaches(device, mainCache, static_cast<uint32_t>(workerCaches.size()), workerCaches.data());
+			}
+			for (auto cache : workerCaches) {
+				vkDestroyPipelineCache(device, cache, allocator);
+			}
+			workerCaches.clear();
+		}
+	}
+};
+
+
+/* copies presented images into a ring of persistently mapped host buffers and hands them to a writer thread
+   once the GPU has finished the frame. if every buffer is still waiting on the GPU or the disk the frame is
+   dropped from the capture instead of stalling the render loop */
+class FrameCapture {
+public:
+	struct Stats {
+		uint64_t captured = 0;
+		uint64_t dropped = 0;
+		uint32_t peakQueued = 0; // waiting for the writer
+	};
+	
+	// header in front of every frame of a CaptureFormat::Stream file, pixels follow as tightly packed RGBA8
+	struct StreamFrameHeader {
+		uint32_t magic;
+		uint32_t width;
+		uint32_t height;
+		uint32_t reserved;
+		uint64_t frameNumber;
+		uint64_t dataSize;
+	};
+	static constexpr uint32_t STREAM_MAGIC = 0x53465456; // "VTFS"
+	
+	void init(DeviceMemoryAllocator& memoryAllocator, CaptureFormat format, const std::string& path, uint32_t slotCount) {
+		this->memoryAllocator = &memoryAllocator;
+		this->format = format;
+		this->path = path;
+		slots.clear();
+		for (uint32_t i = 0 ; i < slotCount ; ++i) {
+			slots.push_back(std::make_unique<Slot>());
+		}
+		if (format == CaptureFormat::Stream) {
+			stream.open(path, std::ios::binary | std::ios::trunc);
+			if (!stream.is_open()) {
+				throw std::runtime_error("failed to open capture stream: " + path);
+			}
+		}
+		stopping = false;
+		writer = std::thread([this] { writerLoop(); });
+	}
+	
+	// finishes writing everything already handed over, frames still on the GPU are lost
+	void destroy() {
+		if (!writer.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		writer.join();
+		for (auto& slot : slots) {
+			memoryAllocator->destroyBuffer(slot->buffer);
+		}
+		slots.clear();
+		stream.close();
+	}
+	
+	/* a free buffer for frameNumber's image, VK_NULL_HANDLE if every one is still busy and the frame is dropped.
+	   frameNumber must be unique and increasing, collect() hands the buffer to the writer once that frame has
+	   completed. the caller records the copy with recordCopy() and the barriers around it */
+	VkBuffer reserve(VkExtent2D extent, VkFormat imageFormat, uint64_t frameNumber) {
+		VkDeviceSize size = VkDeviceSize{extent.width} * extent.height * 4;
+		Slot *slot = nullptr;
+		for (auto& candidate : slots) {
+			if (candidate->state.load(std::memory_order_acquire) == SlotState::Free) {
+				slot = candidate.get();
+				break;
+			}
+		}
+		if (!slot) {
+			if (stats.dropped++ == 0) {
+				std::cerr << "capture: writer can't keep up, dropping frames\n";
+			}
+			return VK_NULL_HANDLE;
+		}
+		
+		if (!slot->buffer || slot->buffer->size < size) {
+			memoryAllocator->destroyBuffer(slot->buffer); // swapchain grew, free slots can be resized
+			slot->buffer = memoryAllocator->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		}
+		slot->extent = extent;
+		slot->swizzle = imageFormat == VK_FORMAT_B8G8R8A8_UNORM || imageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+		slot->frameNumber = frameNumber;
+		slot->state.store(SlotState::InFlight, std::memory_order_release);
+		++stats.captured;
+		return slot->buffer->buffer;
+	}
+	
+	// image in TRANSFER_SRC_OPTIMAL, buffer from reserve()
+	static void recordCopy(VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, VkBuffer buffer) {
+		VkBufferImageCopy region{};
+		region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		region.imageExtent = {extent.width, extent.height, 1};
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+	}
+	
+	// every frame before framesCompleted has finished on the GPU, their buffers can go to the writer
+	void collect(uint64_t framesCompleted) {
+		uint32_t queued = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& slot : slots) {
+				if (slot->state.load(std::memory_order_acquire) == SlotState::InFlight && slot->frameNumber < framesCompleted) {
+					slot->state.store(SlotState::Queued, std::memory_order_release);
+					writeQueue.push_back(slot.get());
+				}
+			}
+			// oldest first, so a stream file stays in frame order
+			std::sort(writeQueue.begin(), writeQueue.end(), [](const Slot *a, const Slot *b) { return a->frameNumber < b->frameNumber; });
+			queued = static_cast<uint32_t>(writeQueue.size());
+		}
+		stats.peakQueued = std::max(stats.peakQueued, queued);
+		if (queued != 0) wake.notify_one();
+	}
+	
+	void printStats(std::ostream& out) {
+		std::lock_guard<std::mutex> lock(mutex);
+		out << "capture: " << stats.captured << " frames captured, " << written << " written ("
+		    << std::fixed << std::setprecision(1) << writtenBytes / (1024.0 * 1024.0) << " MiB, "
+		    << (writeSeconds > 0.0 ? writtenBytes / (1024.0 * 1024.0) / writeSeconds : 0.0) << " MiB/s), "
+		    << stats.dropped << " dropped, peak " << stats.peakQueued << " queued for the writer\n";
+	}
+	
+private:
+	enum class SlotState { Free, InFlight, Queued };
+	
+	struct Slot {
+		DeviceMemoryAllocator::Buffer *buffer = nullptr;
+		VkExtent2D extent{};
+		bool swizzle = false; // BGRA swapchain, written out as RGBA
+		uint64_t frameNumber = 0;
+		std::atomic<SlotState> state{SlotState::Free};
+	};
+	
+	DeviceMemoryAllocator *memoryAllocator = nullptr;
+	CaptureFormat format = CaptureFormat::Raw;
+	std::string path;
+	std::ofstream stream;
+	std::vector<std::unique_ptr<Slot>> slots;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Slot*> writeQueue; // guarded by mutex
+	bool stopping = false;        // guarded by mutex
+	Stats stats;                  // render thread only
+	uint64_t written = 0;         // guarded by mutex, updated by the writer
+	uint64_t writtenBytes = 0;
+	double writeSeconds = 0.0;
+	std::vector<char> scratch;    // writer thread only
+	
+	void writerLoop() {
+		for (;;) {
+			Slot *slot;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || !writeQueue.empty(); });
+				if (writeQueue.empty()) return; // stopping, and everything handed over is on disk
+				slot = writeQueue.front();
+				writeQueue.pop_front();
+			}
+			
+			auto start = std::chrono::steady_clock::now();
+			size_t bytes = writeFrame(*slot);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			slot->state.store(SlotState::Free, std::memory_order_release);
+			
+			std::lock_guard<std::mutex> lock(mutex);
+			++written;
+			writtenBytes += bytes;
+			writeSeconds += seconds;
+		}
+	}
+	
+	size_t writeFrame(const Slot& slot) {
+		size_t pixelCount = size_t{slot.extent.width} * slot.extent.height;
+		const char *pixels = static_cast<const char*>(slot.buffer->allocation.mapped);
+		
+		if (format == CaptureFormat::Ppm) {
+			// P6 has no alpha, drop it while converting
+			scratch.resize(pixelCount * 3);
+			int r = slot.swizzle ? 2 : 0, b = slot.swizzle ? 0 : 2;
+			for (size_t i = 0 ; i < pixelCount ; ++i) {
+				scratch[3 * i] = pixels[4 * i + r];
+				scratch[3 * i + 1] = pixels[4 * i + 1];
+				scratch[3 * i + 2] = pixels[4 * i + b];
+			}
+			std::ofstream file(framePath(slot.frameNumber, ".ppm"), std::ios::binary | std::ios::trunc);
+			file << "P6\n" << slot.extent.width << ' ' << slot.extent.height << "\n255\n";
+			file.write(scratch.data(), scratch.size());
+			return scratch.size();
+		}
+		
+		const char *rgba = pixels;
+		if (slot.swizzle) {
+			scratch.assign(pixels, pixels + pixelCount * 4);
+			for (size_t i = 0 ; i < pixelCount ; ++i) {
+				std::swap(scratch[4 * i], scratch[4 * i + 2]);
+			}
+			rgba = scratch.data();
+		}
+		if (format == CaptureFormat::Stream) {
+			StreamFrameHeader header{STREAM_MAGIC, slot.extent.width, slot.extent.height, 0, slot.frameNumber, pixelCount * 4};
+			stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			stream.write(rgba, pixelCount * 4);
+		} else {
+			std::ofstream file(framePath(slot.frameNumber, ".rgba"), std::ios::binary | std::ios::trunc);
+			file.write(rgba, pixelCount * 4);
+		}
+		return pixelCount * 4;
+	}
+	
+	std::string framePath(uint64_t frameNumber, const char *extension) const {
+		std::ostringstream name;
+		name << path << '_' << std::setw(6) << std::setfill('0') << frameNumber << extension;
+		return name.str();
+	}
+};
+
+
+/* one frame's GPU work as passes that declare what they read and write. compile() drops passes nothing
+   depends on, places the barriers between the rest (batched into one vkCmdPipelineBarrier in front of
+   every pass that needs any) and gives transient images whose lifetimes don't overlap the same memory.
+   passes run in the order they were added, a read sees the latest write added before it.
+   rebuilt every frame; the transient images of a frame slot are kept as long as the next graph built for
+   that slot declares the same ones with the same lifetimes */
+class RenderGraph {
+public:
+	using Resource = uint32_t;
+	using Execute = std::function<void(VkCommandBuffer, const RenderGraph&)>;
+	
+	/* how a pass touches a resource. layout is the one the pass needs, UNDEFINED when it discards the contents
+	   and transitions the image itself (a render pass with initialLayout UNDEFINED, its external subpass
+	   dependency is trusted to cover an imported image's initial state). layoutAfter is what the
+	   pass leaves behind if it changes it itself (a render pass's finalLayout). buffers ignore both */
+	struct Access {
+		VkPipelineStageFlags stage = 0;
+		VkAccessFlags access = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout layoutAfter = VK_IMAGE_LAYOUT_UNDEFINED; // UNDEFINED = layout
+	};
+	
+	struct ImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent{};
+		VkImageUsageFlags usage = 0;
+		
+		bool operator==(const ImageDesc& other) const {
+			return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height && usage == other.usage;
+		}
+	};
+	
+	struct Stats {
+		uint64_t frames = 0;
+		uint64_t passes = 0;
+		uint64_t culledPasses = 0;
+		uint64_t barrierCalls = 0;    // vkCmdPipelineBarrier
+		uint64_t imageBarriers = 0;
+		uint64_t bufferBarriers = 0;
+		uint64_t memoryBarriers = 0;  // global ones, for aliased memory changing hands without a layout transition
+		uint64_t accesses = 0;        // declared by live passes, what one barrier each would have cost
+		uint32_t transientAllocations = 0;
+		VkDeviceSize transientBytes = 0;  // of the last frame, as if every transient image had its own memory
+		VkDeviceSize allocatedBytes = 0;  // of the last frame, with aliasing
+	};
+	
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, DeviceMemoryAllocator& memoryAllocator, uint32_t frameCount) {
+		this->device = device;
+		this->allocator = allocator;
+		this->memoryAllocator = &memoryAllocator;
+		slots.resize(frameCount);
+	}
+	
+	// the device must be idle
+	void destroy() {
+		for (auto& slot : slots) {
+			destroyTransients(slot);
+		}
+		slots.clear();
+	}
+	
+	// starts a new graph for frame slot frameIndex, whose previous frame has finished on the GPU
+	void begin(uint32_t frameIndex) {
+		currentSlot = frameIndex;
+		resources.clear();
+		passes.clear();
+		order.clear();
+		finalBatch = {};
+		compiled = false;
+	}
+	
+	Resource importImage(const char *name, VkImage image, const Access& initial, const Access& final) {
+		Resource resource = addResource(name, Kind::ImportedImage);
+		resources[resource].image = image;
+		resources[resource].initial = initial;
+		resources[resource].final = final;
+		return resource;
+	}
+	
+	Resource importBuffer(const char *name, VkBuffer buffer, const Access& initial, const Access& final) {
+		Resource resource = addResource(name, Kind::ImportedBuffer);
+		resources[resource].buffer = buffer;
+		resources[resource].initial = initial;
+		resources[resource].final = final;
+		return resource;
+	}
+	
+	// lives from its first to its last use in this frame, starts out with undefined contents
+	Resource createImage(const char *name, const ImageDesc& desc) {
+		Resource resource = addResource(name, Kind::TransientImage);
+		resources[resource].desc = desc;
+		return resource;
+	}
+	
+	// sideEffects: keep it even if nothing reads what it writes
+	uint32_t addPass(const char *name, Execute execute, bool sideEffects = false) {
+		Pass pass{};
+		pass.name = name;
+		pass.execute = std::move(execute);
+		pass.sideEffects = sideEffects;
+		passes.push_back(std::move(pass));
+		return static_cast<uint32_t>(passes.size() - 1);
+	}
+	
+	void read(uint32_t pass, Resource resource, const Access& access) {
+		passes[pass].accesses.push_back({resource, access, false});
+	}
+	
+	void write(uint32_t pass, Resource resource, const Access& access) {
+		passes[pass].accesses.push_back({resource, access, true});
+	}
+	
+	void compile() {
+		cull();
+		allocateTransients();
+		placeBarriers();
+		compiled = true;
+		
+		++stats.frames;
+		stats.passes += order.size();
+		stats.culledPasses += passes.size() - order.size();
+	}
+	
+	void execute(VkCommandBuffer commandBuffer) {
+		if (!compiled) {
+			throw std::runtime_error("render graph executed without compile()");
+		}
+		for (uint32_t pass : order) {
+			recordBatch(commandBuffer, passes[pass].barriers);
+			passes[pass].execute(commandBuffer, *this);
+		}
+		recordBatch(commandBuffer, finalBatch);
+	}
+	
+	VkImage getImage(Resource resource) const {
+		const auto& entry = resources[resource];
+		return entry.kind == Kind::TransientImage ? slots[currentSlot].images[entry.transientIndex].image : entry.image;
+	}
+	
+	VkImageView getView(Resource resource) const {
+		const auto& entry = resources[resource];
+		return entry.kind == Kind::TransientImage ? slots[currentSlot].images[entry.transientIndex].view : VK_NULL_HANDLE;
+	}
+	
+	VkBuffer getBuffer(Resource resource) const { return resources[resource].buffer; }
+	
+	/* changes whenever the current slot's transient images are recreated, never repeats. handle values of destroyed
+	   views can come back, so anything built on the views (framebuffers) is keyed on this instead */
+	uint64_t getGeneration() const { return slots[currentSlot].generation; }
+	
+	Stats getStats() const { return stats; }
+	
+	void printStats(std::ostream& out) const {
+		if (stats.frames == 0) return;
+		double frames = static_cast<double>(stats.frames);
+		out << "render graph: " << std::fixed << std::setprecision(1) << stats.passes / frames << " passes/frame ("
+		    << stats.culledPasses / frames << " culled), " << stats.barrierCalls / frames << " barrier calls/frame with "
+		    << stats.imageBarriers / frames << " image, " << stats.bufferBarriers / frames << " buffer, "
+		    << stats.memoryBarriers / frames << " memory barriers for " << stats.accesses / frames << " accesses\n";
+		if (stats.transientBytes != 0) {
+			out << "render graph: transient images " << stats.transientBytes / 1024 << " KiB, " << stats.allocatedBytes / 1024
+			    << " KiB allocated, " << (stats.transientBytes - stats.allocatedBytes) / 1024 << " KiB saved by aliasing, "
+			    << stats.transientAllocations << " allocations\n";
+		}
+	}
+	
+private:
+	enum class Kind { ImportedImage, ImportedBuffer, TransientImage };
+	
+	struct ResourceEntry {
+		const char *name;
+		Kind kind;
+		VkImage image = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Access initial, final;    // imported only
+		ImageDesc desc;           // transient only
+		uint32_t transientIndex = 0;
+		bool needed = false;      // read by a live pass
+	};
+	
+	struct Batch {
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+		std::vector<VkMemoryBarrier> memoryBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	};
+	
+	struct PassAccess {
+		Resource resource;
+		Access access;
+		bool write;
+	};
+	
+	struct Pass {
+		const char *name;
+		Execute execute;
+		bool sideEffects;
+		std::vector<PassAccess> accesses;
+		Batch barriers; // recorded in front of it
+	};
+	
+	// what a transient image needs to be the same one as last time in its slot
+	struct TransientKey {
+		ImageDesc desc;
+		uint32_t firstUse, lastUse; // positions in the live pass order
+		bool operator==(const TransientKey& other) const {
+			return desc == other.desc && firstUse == other.firstUse && lastUse == other.lastUse;
+		}
+	};
+	
+	struct TransientImage {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0, size = 0;
+		std::vector<uint32_t> aliases; // earlier transients sharing some of its memory, it has to wait for them
+	};
+	
+	struct Slot {
+		std::vector<TransientKey> keys;
+		std::vector<TransientImage> images;
+		DeviceMemoryAllocator::Allocation memory{};
+		VkDeviceSize transientBytes = 0;
+		uint64_t generation = 0; // of images, 0 while it has none
+	};
+	
+	// synchronization state of one resource while walking the passes
+	struct Tracked {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0; // of the last write
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;  // reads since then that already waited for it
+		VkAccessFlags readAccess = 0;
+		bool external = false;                // nothing but what happened before the graph so far
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	DeviceMemoryAllocator *memoryAllocator = nullptr;
+	std::vector<Slot> slots;
+	uint32_t currentSlot = 0;
+	uint64_t generations = 0; // handed out to slots so far
+	std::vector<ResourceEntry> resources;
+	std::vector<Pass> passes;
+	std::vector<uint32_t> order; // live passes
+	Batch finalBatch;            // brings imported resources into their final state
+	bool compiled = false;
+	Stats stats;
+	
+	Resource addResource(const char *name, Kind kind) {
+		ResourceEntry entry{};
+		entry.name = name;
+		entry.kind = kind;
+		resources.push_back(entry);
+		return static_cast<Resource>(resources.size() - 1);
+	}
+	
+	// walking backwards: a pass is live if it has side effects or writes something that outlives the graph or a live pass reads
+	void cull() {
+		std::vector<bool> live(passes.size(), false);
+		for (size_t i = passes.size() ; i-- > 0 ; ) {
+			const Pass& pass = passes[i];
+			bool isLive = pass.sideEffects;
+			for (const auto& access : pass.accesses) {
+				const ResourceEntry& resource = resources[access.resource];
+				if (access.write && (resource.kind != Kind::TransientImage || resource.needed)) isLive = true;
+			}
+			if (!isLive) continue;
+			live[i] = true;
+			for (const auto& access : pass.accesses) {
+				if (!access.write) resources[access.resource].needed = true;
+			}
+		}
+		for (uint32_t i = 0 ; i < passes.size() ; ++i) {
+			if (live[i]) order.push_back(i);
+		}
+	}
+	
+	/* transients used by live passes get an offset in one allocation per slot: biggest first, each at the lowest
+	   offset where it overlaps nothing already placed that is alive at the same time */
+	void allocateTransients() {
+		std::vector<TransientKey> keys;
+		std::vector<Resource> transients;
+		for (uint32_t position = 0 ; position < order.size() ; ++position) {
+			for (const auto& access : passes[order[position]].accesses) {
+				ResourceEntry& resource = resources[access.resource];
+				if (resource.kind != Kind::TransientImage) continue;
+				auto it = std::find(transients.begin(), transients.end(), access.resource);
+				if (it == transients.end()) {
+					resource.transientIndex = static_cast<uint32_t>(transients.size());
+					transients.push_back(access.resource);
+					keys.push_back({resource.desc, position, position});
+				} else {
+					keys[it - transients.begin()].lastUse = position;
+				}
+			}
+		}
+		
+		Slot& slot = slots[currentSlot];
+		if (keys == slot.keys && !keys.empty()) {
+			stats.transientBytes = slot.transientBytes;
+			stats.allocatedBytes = slot.memory.size;
+			return;
+		}
+		destroyTransients(slot); // the slot's last frame is done, nothing uses them anymore
+		slot.keys = keys;
+		if (keys.empty()) {
+			stats.transientBytes = stats.allocatedBytes = 0;
+			return;
+		}
+		
+		slot.images.resize(keys.size());
+		VkMemoryRequirements combined{0, 1, ~0u};
+		for (uint32_t i = 0 ; i < keys.size() ; ++i) {
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = keys[i].desc.format;
+			imageInfo.extent = {keys[i].desc.extent.width, keys[i].desc.extent.height, 1};
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageInfo.usage = keys[i].desc.usage;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (vkCreateImage(device, &imageInfo, allocator, &slot.images[i].image) != VK_SUCCESS) {
+				throw std::runtime_error(std::string("failed to create transient image ") + resources[transients[i]].name);
+			}
+			VkMemoryRequirements requirements;
+			vkGetImageMemoryRequirements(device, slot.images[i].image, &requirements);
+			slot.images[i].size = requirements.size;
+			combined.alignment = std::max(combined.alignment, requirements.alignment);
+			combined.memoryTypeBits &= requirements.memoryTypeBits;
+			slot.transientBytes += requirements.size;
+		}
+		if (combined.memoryTypeBits == 0) {
+			throw std::runtime_error("transient images have no memory type in common");
+		}
+		
+		std::vector<uint32_t> bySize(keys.size());
+		for (uint32_t i = 0 ; i < bySize.size() ; ++i) bySize[i] = i;
+		std::stable_sort(bySize.begin(), bySize.end(), [&](uint32_t a, uint32_t b) { return slot.images[a].size > slot.images[b].size; });
+		std::vector<uint32_t> placed;
+		for (uint32_t i : bySize) {
+			auto overlapsInTime = [&](uint32_t other) { return keys[i].firstUse <= keys[other].lastUse && keys[other].firstUse <= keys[i].lastUse; };
+			VkDeviceSize offset = 0;
+			for (bool moved = true ; moved ; ) {
+				moved = false;
+				for (uint32_t other : placed) {
+					const TransientImage& image = slot.images[other];
+					if (overlapsInTime(other) && offset < image.offset + image.size && image.offset < offset + slot.images[i].size) {
+						offset = (image.offset + image.size + combined.alignment - 1) / combined.alignment * combined.alignment;
+						moved = true;
+					}
+				}
+			}
+			slot.images[i].offset = offset;
+			combined.size = std::max(combined.size, offset + slot.images[i].size);
+			placed.push_back(i);
+		}
+		
+		slot.memory = memoryAllocator->allocate(combined, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, DeviceMemoryAllocator::Lifetime::Persistent, true);
+		for (uint32_t i = 0 ; i < keys.size() ; ++i) {
+			TransientImage& image = slot.images[i];
+			vkBindImageMemory(device, image.image, slot.memory.memory, slot.memory.offset + image.offset);
+			
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = image.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = keys[i].desc.format;
+			viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+			if (vkCreateImageView(device, &viewInfo, allocator, &image.view) != VK_SUCCESS) {
+				throw std::runtime_error(std::string("failed to create transient image view ") + resources[transients[i]].name);
+			}
+			for (uint32_t other = 0 ; other < keys.size() ; ++other) {
+				const TransientImage& earlier = slot.images[other];
+				if (keys[other].lastUse < keys[i].firstUse && image.offset < earlier.offset + earlier.size && earlier.offset < image.offset + image.size) {
+					image.aliases.push_back(other);
+				}
+			}
+		}
+		slot.generation = ++generations;
+		++stats.transientAllocations;
+		stats.transientBytes = slot.transientBytes;
+		stats.allocatedBytes = slot.memory.size;
+	}
+	
+	void destroyTransients(Slot& slot) {
+		for (auto& image : slot.images) {
+			vkDestroyImageView(device, image.view, allocator);
+			vkDestroyImage(device, image.image, allocator);
+		}
+		slot.images.clear();
+		if (slot.memory.memory != VK_NULL_HANDLE) {
+			memoryAllocator->free(slot.memory);
+			slot.memory = {};
+		}
+		slot.keys.clear();
+		slot.transientBytes = 0;
+		slot.generation = 0;
+	}
+	
+	void placeBarriers() {
+		std::vector<Tracked> tracked(resources.size());
+		for (uint32_t i = 0 ; i < resources.size() ; ++i) {
+			if (resources[i].kind == Kind::TransientImage) continue;
+			// whatever came before the graph counts as a write it has to wait for, e.g. the acquire semaphore's wait stage
+			tracked[i].layout = resources[i].initial.layout;
+			tracked[i].writeStages = resources[i].initial.stage;
+			tracked[i].writeAccess = resources[i].initial.access;
+			tracked[i].external = true;
+		}
+		
+		// the last state of every transient, for the ones aliasing it later
+		std::vector<Tracked> transientEnd(slots[currentSlot].images.size());
+		std::vector<bool> touched(resources.size(), false);
+		
+		for (uint32_t pass : order) {
+			Batch& batch = passes[pass].barriers;
+			for (const auto& use : passes[pass].accesses) {
+				++stats.accesses;
+				ResourceEntry& resource = resources[use.resource];
+				Tracked& state = tracked[use.resource];
+				if (resource.kind == Kind::TransientImage && !touched[use.resource]) {
+					// memory that belonged to an earlier transient: wait for its last users, writes included
+					for (uint32_t alias : slots[currentSlot].images[resource.transientIndex].aliases) {
+						state.writeStages |= transientEnd[alias].writeStages | transientEnd[alias].readStages;
+						state.writeAccess |= transientEnd[alias].writeAccess;
+					}
+				}
+				touched[use.resource] = true;
+				addBarrier(batch, use.resource, state, use.access, use.write);
+				if (resource.kind == Kind::TransientImage) transientEnd[resource.transientIndex] = state;
+			}
+		}
+		
+		for (uint32_t i = 0 ; i < resources.size() ; ++i) {
+			if (resources[i].kind != Kind::TransientImage) {
+				addBarrier(finalBatch, i, tracked[i], resources[i].final, false);
+			}
+		}
+	}
+	
+	// brings resource from state to what access needs, adding to batch whatever that takes, then updates state
+	void addBarrier(Batch& batch, Resource resource, Tracked& state, const Access& access, bool write) {
+		bool isImage = resources[resource].kind != Kind::ImportedBuffer;
+		bool transition = isImage && access.layout != VK_IMAGE_LAYOUT_UNDEFINED && access.layout != state.layout;
+		
+		VkPipelineStageFlags srcStages = 0;
+		VkAccessFlags srcAccess = 0;
+		bool memoryDependency = false;
+		bool renderPassCovers = isImage && state.external && !transition && state.writeAccess == 0 && access.layout == VK_IMAGE_LAYOUT_UNDEFINED;
+		if (renderPassCovers) {
+			// the render pass's external subpass dependency already waits for the acquire semaphore, don't repeat it
+		} else if (write || transition) {
+			// anything before has to be done, earlier writes must be available
+			srcStages = state.writeStages | state.readStages;
+			srcAccess = state.writeAccess;
+			memoryDependency = transition || state.writeAccess != 0;
+		} else if ((access.stage & ~state.readStages) || (access.access & ~state.readAccess)) {
+			// a new kind of read of the last write
+			srcStages = state.writeStages;
+			srcAccess = state.writeAccess;
+			memoryDependency = state.writeAccess != 0;
+		}
+		
+		if (srcStages != 0 || transition) {
+			batch.srcStages |= srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			batch.dstStages |= access.stage != 0 ? access.stage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+			if (memoryDependency && isImage && (transition || access.layout != VK_IMAGE_LAYOUT_UNDEFINED)) {
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = access.access;
+				barrier.oldLayout = transition ? state.layout : access.layout;
+				barrier.newLayout = access.layout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = getImage(resource);
+				barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+				batch.imageBarriers.push_back(barrier);
+			} else if (memoryDependency && !isImage) {
+				VkBufferMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = access.access;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.buffer = getBuffer(resource);
+				barrier.size = VK_WHOLE_SIZE;
+				batch.bufferBarriers.push_back(barrier);
+			} else if (memoryDependency) {
+				// the pass transitions the image itself (render pass), all we owe it is the memory dependency
+				VkMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = srcAccess;
+				barrier.dstAccessMask = access.access;
+				batch.memoryBarriers.push_back(barrier);
+			}
+		}
+		
+		state.external = false;
+		if (write) {
+			state.writeStages = access.stage;
+			state.writeAccess = access.access;
+			state.readStages = 0;
+			state.readAccess = 0;
+		} else if (transition) {
+			state.readStages = access.stage; // earlier readers used the old layout and were waited for
+			state.readAccess = access.access;
+		} else {
+			state.readStages |= access.stage;
+			state.readAccess |= access.access;
+		}
+		if (access.layoutAfter != VK_IMAGE_LAYOUT_UNDEFINED) {
+			state.layout = access.layoutAfter;
+		} else if (access.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+			state.layout = access.layout;
+		}
+	}
+	
+	void recordBatch(VkCommandBuffer commandBuffer, const Batch& batch) {
+		if (batch.srcStages == 0) return;
+		vkCmdPipelineBarrier(commandBuffer, batch.srcStages, batch.dstStages, 0,
+			static_cast<uint32_t>(batch.memoryBarriers.size()), batch.memoryBarriers.data(),
+			static_cast<uint32_t>(batch.bufferBarriers.size()), batch.bufferBarriers.data(),
+			static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+		++stats.barrierCalls;
+		stats.memoryBarriers += batch.memoryBarriers.size();
+		stats.bufferBarriers += batch.bufferBarriers.size();
+		stats.imageBarriers += batch.imageBarriers.size();
+	}
+};
+
+
+// column-major like GLSL, so it goes into push constants as it is
+struct Mat4 {
+	float m[16] = {};
+	
+	Mat4 operator*(const Mat4& other) const {
+		Mat4 result;
+		for (int column = 0 ; column < 4 ; ++column) {
+			for (int row = 0 ; row < 4 ; ++row) {
+				for (int k = 0 ; k < 4 ; ++k) {
+					result.m[column * 4 + row] += m[k * 4 + row] * other.m[column * 4 + k];
+				}
+			}
+		}
+		return result;
+	}
+	
+	// right handed view space looking down -z into Vulkan clip space: y down, depth 0 at near and 1 at far
+	static Mat4 perspective(float fovY, float aspect, float near, float far) {
+		float f = 1.0f / std::tan(fovY / 2.0f);
+		Mat4 result;
+		result.m[0] = f / aspect;
+		result.m[5] = -f;
+		result.m[10] = far / (near - far);
+		result.m[11] = -1.0f;
+		result.m[14] = near * far / (near - far);
+		return result;
+	}
+	
+	static Mat4 lookAt(std::array<float, 3> eye, std::array<float, 3> center, std::array<float, 3> up) {
+		auto normalize = [](std::array<float, 3> v) {
+			float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			return std::array<float, 3>{v[0] / length, v[1] / length, v[2] / length};
+		};
+		auto cross = [](std::array<float, 3> a, std::array<float, 3> b) {
+			return std::array<float, 3>{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+		};
+		auto dot = [](std::array<float, 3> a, std::array<float, 3> b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; };
+		
+		std::array<float, 3> forward = normalize({center[0] - eye[0], center[1] - eye[1], center[2] - eye[2]});
+		std::array<float, 3> side = normalize(cross(forward, up));
+		std::array<float, 3> realUp = cross(side, forward);
+		Mat4 result;
+		for (int i = 0 ; i < 3 ; ++i) {
+			result.m[i * 4 + 0] = side[i];
+			result.m[i * 4 + 1] = realUp[i];
+			result.m[i * 4 + 2] = -forward[i];
+		}
+		result.m[12] = -dot(side, eye);
+		result.m[13] = -dot(realUp, eye);
+		result.m[14] = dot(forward, eye);
+		result.m[15] = 1.0f;
+		return result;
+	}
+};
+
+/* frustum culls instances in a compute shader that writes one indexed indirect draw per instance, so the CPU
+   records the same few commands for any instance count. instances are a structure of arrays in one storage
+   buffer (every center x, then every y, z and scale), so neighbouring invocations read neighbouring floats.
+   with vkCmdDrawIndexedIndirectCount the visible draws are compacted behind an atomic counter, without it every
+   instance keeps its slot and culled ones are drawn with 0 instances. there's a single draw buffer: the render
+   graph makes the next frame's cull wait for this frame's indirect reads, they're in submission order anyway */
+class InstanceCuller {
+public:
+	static constexpr uint32_t WORKGROUP_SIZE = 64; // local_size_x of cull.comp
+	static constexpr uint32_t MAX_INSTANCES = 65535 * WORKGROUP_SIZE; // the dispatch size every device supports
+	
+	struct Stats {
+		uint32_t instanceCount = 0;
+		uint64_t cullDispatches = 0;
+		uint64_t indirectCalls = 0;
+	};
+	
+	/* drawIndirectCount is vkCmdDrawIndexedIndirectCountKHR or nullptr, maxDrawIndirectCount is 1 without the
+	   multiDrawIndirect feature. cullShader is only used during init */
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, DeviceMemoryAllocator& memoryAllocator, UploadRing& uploadRing,
+	          VkDeviceSize maxUploadBytes, VkPipelineCache pipelineCache, VkShaderModule cullShader, uint32_t instanceCount,
+	          PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount, uint32_t maxDrawIndirectCount) {
+		if (instanceCount > MAX_INSTANCES) {
+			throw std::runtime_error("instance culling: at most " + std::to_string(MAX_INSTANCES) + " instances");
+		}
+		this->device = device;
+		this->allocator = allocator;
+		this->memoryAllocator = &memoryAllocator;
+		this->instanceCount = instanceCount;
+		this->maxDrawIndirectCount = std::max(maxDrawIndirectCount, 1u);
+		// the count path can't be split into several calls, it needs all draws in one
+		this->drawIndirectCount = maxDrawIndirectCount >= instanceCount ? drawIndirectCount : nullptr;
+		stats.instanceCount = instanceCount;
+		
+		createDescriptors();
+		createPipeline(pipelineCache, cullShader);
+		createBuffers(uploadRing, maxUploadBytes);
+	}
+	
+	void destroy() {
+		if (device == VK_NULL_HANDLE) return;
+		memoryAllocator->destroyBuffer(instanceBuffer);
+		memoryAllocator->destroyBuffer(drawBuffer);
+		memoryAllocator->destroyBuffer(countBuffer);
+		vkDestroyPipeline(device, pipeline, allocator);
+		vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+		vkDestroyDescriptorPool(device, descriptorPool, allocator);
+		vkDestroyDescriptorSetLayout(device, setLayout, allocator);
+		device = VK_NULL_HANDLE;
+	}
+	
+	bool active() const { return device != VK_NULL_HANDLE; }
+	bool compacted() const { return drawIndirectCount != nullptr; }
+	float sceneRadius() const { return radius; }
+	
+	// set 0 of the graphics pipeline layout, with drawConstantRange() as its push constants
+	VkDescriptorSetLayout getSetLayout() const { return setLayout; }
+	static VkPushConstantRange drawConstantRange() { return {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawConstants)}; }
+	
+	VkBuffer getDrawBuffer() const { return drawBuffer->buffer; }
+	VkBuffer getCountBuffer() const { return countBuffer->buffer; } // only with compacted()
+	
+	// a transfer, before recordCull() with compacted()
+	void recordReset(VkCommandBuffer commandBuffer) {
+		vkCmdFillBuffer(commandBuffer, countBuffer->buffer, 0, sizeof(uint32_t), 0);
+	}
+	
+	void recordCull(VkCommandBuffer commandBuffer, const Mat4& viewProjection, uint32_t indexCount) {
+		CullConstants constants{};
+		frustumPlanes(viewProjection, constants.planes);
+		constants.instanceCount = instanceCount;
+		constants.indexCount = indexCount;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+		++stats.cullDispatches;
+	}
+	
+	// the instanced pipeline, its vertex and index buffers are bound already; layout has getSetLayout() as set 0
+	void recordDraws(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const Mat4& viewProjection) {
+		DrawConstants constants{viewProjection, instanceCount};
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+		
+		constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		if (drawIndirectCount) {
+			drawIndirectCount(commandBuffer, drawBuffer->buffer, 0, countBuffer->buffer, 0, instanceCount, stride);
+			++stats.indirectCalls;
+			return;
+		}
+		// without multiDrawIndirect this is one call per instance again, only the culling moved to the GPU
+		for (uint32_t first = 0 ; first < instanceCount ; first += maxDrawIndirectCount) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer->buffer, VkDeviceSize{first} * stride,
+				std::min(maxDrawIndirectCount, instanceCount - first), stride);
+			++stats.indirectCalls;
+		}
+	}
+	
+	const Stats& getStats() const { return stats; }
+	
+	// after the device is idle, the visible count is the last frame's
+	void printStats(std::ostream& out) const {
+		if (!active()) return;
+		out << "instance culling: " << instanceCount << " instances, ";
+		if (compacted()) {
+			uint32_t visible = *static_cast<const uint32_t*>(countBuffer->allocation.mapped);
+			out << visible << " visible in the last frame, drawn with vkCmdDrawIndexedIndirectCount";
+		} else {
+			out << "drawn with vkCmdDrawIndexedIndirect, up to " << maxDrawIndirectCount << " draws per call";
+		}
+		out << ", " << stats.cullDispatches << " cull dispatches, "
+		    << (stats.cullDispatches == 0 ? 0.0 : static_cast<double>(stats.indirectCalls) / stats.cullDispatches) << " indirect calls/frame\n";
+	}
+	
+private:
+	// must match the push constant blocks of cull.comp and instanced.vert
+	struct CullConstants {
+		float planes[6][4];
+		uint32_t instanceCount;
+		uint32_t indexCount;
+	};
+	struct DrawConstants {
+		Mat4 viewProjection;
+		uint32_t instanceCount;
+	};
+	
+	static constexpr float SPACING = 6.0f; // average distance between neighbouring instances
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	DeviceMemoryAllocator *memoryAllocator = nullptr;
+	uint32_t instanceCount = 0;
+	uint32_t maxDrawIndirectCount = 1;
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount = nullptr;
+	float radius = 0.0f;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	DeviceMemoryAllocator::Buffer *instanceBuffer = nullptr;
+	DeviceMemoryAllocator::Buffer *drawBuffer = nullptr;
+	DeviceMemoryAllocator::Buffer *countBuffer = nullptr;
+	Stats stats;
+	
+	// Gribb/Hartmann, for clip space depth 0..w; normalized so the distance can be compared with a radius
+	static void frustumPlanes(const Mat4& viewProjection, float (&planes)[6][4]) {
+		auto row = [&](int i, int column) { return viewProjection.m[column * 4 + i]; };
+		for (int column = 0 ; column < 4 ; ++column) {
+			planes[0][column] = row(3, column) + row(0, column); // left
+			planes[1][column] = row(3, column) - row(0, column); // right
+			planes[2][column] = row(3, column) + row(1, column);
+			planes[3][column] = row(3, column) - row(1, column);
+			planes[4][column] = row(2, column);                  // near
+			planes[5][column] = row(3, column) - row(2, column); // far
+		}
+		for (auto& plane : planes) {
+			float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			for (float& value : plane) value /= length;
+		}
+	}
+	
+	void createDescriptors() {
+		VkDescriptorSetLayoutBinding bindings[3]{};
+		for (uint32_t i = 0 ; i < 3 ; ++i) {
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		bindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT; // instanced.vert reads the instances too
+		
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 3;
+		layoutInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocator, &setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create instance culling descriptor set layout");
+		}
+		
+		VkDescriptorPoolSize size{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3};
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets = 1;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &size;
+		if (vkCreateDescriptorPool(device, &poolInfo, allocator, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create instance culling descriptor pool");
+		}
+		
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &setLayout;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate instance culling descriptor set");
+		}
+	}
+	
+	void createPipeline(VkPipelineCache pipelineCache, VkShaderModule cullShader) {
+		VkPushConstantRange pushConstants{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants)};
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &setLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstants;
+		if (vkCreatePipelineLayout(device, &layoutInfo, allocator, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create instance culling pipeline layout");
+		}
+		
+		VkBool32 compact = compacted() ? VK_TRUE : VK_FALSE;
+		VkSpecializationMapEntry mapEntry{0, 0, sizeof(compact)}; // COMPACT
+		VkSpecializationInfo specializationInfo{1, &mapEntry, sizeof(compact), &compact};
+		
+		VkComputePipelineCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		createInfo.stage.module = cullShader;
+		createInfo.stage.pName = "main";
+		createInfo.stage.pSpecializationInfo = &specializationInfo;
+		createInfo.layout = pipelineLayout;
+		if (vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, allocator, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create instance culling pipeline");
+		}
+	}
+	
+	// instances scattered through a cube with the same density for every count, at random sizes
+	void createBuffers(UploadRing& uploadRing, VkDeviceSize maxUploadBytes) {
+		radius = 0.5f * SPACING * std::cbrt(static_cast<float>(instanceCount));
+		std::mt19937 random(1234); // the same scene every run, so runs can be compared
+		std::uniform_real_distribution<float> position(-radius, radius);
+		std::uniform_real_distribution<float> scale(0.25f, 1.0f);
+		std::vector<float> instances(4 * size_t{instanceCount});
+		for (uint32_t i = 0 ; i < instanceCount ; ++i) {
+			for (uint32_t axis = 0 ; axis < 3 ; ++axis) {
+				instances[axis * size_t{instanceCount} + i] = position(random);
+			}
+			instances[3 * size_t{instanceCount} + i] = scale(random);
+		}
+		
+		VkDeviceSize instanceBytes = instances.size() * sizeof(float);
+		instanceBuffer = memoryAllocator->createBuffer(instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		VkDeviceSize drawBytes = VkDeviceSize{instanceCount} * sizeof(VkDrawIndexedIndirectCommand);
+		drawBuffer = memoryAllocator->createBuffer(drawBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		// host visible so printStats() can tell how much survived
+		countBuffer = memoryAllocator->createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		*static_cast<uint32_t*>(countBuffer->allocation.mapped) = 0;
+		
+		const char *data = reinterpret_cast<const char*>(instances.data());
+		for (VkDeviceSize offset = 0 ; offset < instanceBytes ; offset += maxUploadBytes) {
+			uploadRing.uploadBuffer(instanceBuffer->buffer, offset, data + offset, std::min(maxUploadBytes, instanceBytes - offset),
+				VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+		}
+		
+		VkDescriptorBufferInfo bufferInfos[3] = {
+			{instanceBuffer->buffer, 0, VK_WHOLE_SIZE},
+			{drawBuffer->buffer, 0, VK_WHOLE_SIZE},
+			{countBuffer->buffer, 0, VK_WHOLE_SIZE},
+		};
+		VkWriteDescriptorSet writes[3]{};
+		for (uint32_t i = 0 ; i < 3 ; ++i) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+		vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+	}
+};
+
+
+/* one deque per thread, the owner pushes and pops at the back, idle threads steal from the front of someone
+   else's. the thread calling parallelFor() is thread 0 and works through jobs too instead of sleeping */
+class JobSystem {
+public:
+	struct Stats {
+		uint64_t jobs = 0;
+		uint64_t steals = 0;
+	};
+	
+	void init(uint32_t threadCount) {
+		stopping = false;
+		queues.clear();
+		for (uint32_t i = 0 ; i < std::max(threadCount, 1u) ; ++i) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+		for (uint32_t i = 1 ; i < queues.size() ; ++i) {
+			workers.emplace_back([this, i] { workerLoop(i); });
+		}
+	}
+	
+	void shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+	
+	uint32_t threadCount() const { return static_cast<uint32_t>(queues.size()); }
+	
+	// runs fn(index, threadIndex) for index in [0, count) and returns once all of them ran, rethrowing the first exception
+	void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& fn) {
+		Group group{fn, {count}, nullptr, {}};
+		for (uint32_t index = 0 ; index < count ; ++index) {
+			Queue& queue = *queues[index % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(Job{&group, index});
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			queuedJobs += count;
+		}
+		wake.notify_all();
+		
+		while (group.remaining.load(std::memory_order_acquire) != 0) {
+			if (!runOne(0)) {
+				std::this_thread::yield(); // the last jobs are running elsewhere
+			}
+		}
+		if (group.exception) {
+			std::rethrow_exception(group.exception);
+		}
+	}
+	
+	Stats getStats() const {
+		Stats stats{};
+		for (const auto& queue : queues) {
+			stats.jobs += queue->jobsRun.load(std::memory_order_relaxed);
+			stats.steals += queue->steals.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+	
+private:
+	struct Group {
+		const std::function<void(uint32_t, uint32_t)>& fn;
+		std::atomic<uint32_t> remaining;
+		std::exception_ptr exception;
+		std::mutex exceptionMutex;
+	};
+	
+	struct Job {
+		Group *group;
+		uint32_t index;
+	};
+	
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		std::atomic<uint64_t> jobsRun{0};
+		std::atomic<uint64_t> steals{0};
+	};
+	
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	uint64_t queuedJobs = 0; // guarded by wakeMutex, only used to decide whether to sleep
+	bool stopping = false;
+	
+	bool pop(uint32_t thread, Job& job) {
+		for (uint32_t i = 0 ; i < queues.size() ; ++i) {
+			bool own = i == 0;
+			Queue& queue = *queues[(thread + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) continue;
+			if (own) {
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			} else {
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+				queues[thread]->steals.fetch_add(1, std::memory_order_relaxed);
+			}
+			return true;
+		}
+		return false;
+	}
+	
+	bool runOne(uint32_t thread) {
+		Job job;
+		if (!pop(thread, job)) return false;
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			--queuedJobs;
+		}
+		try {
+			job.group->fn(job.index, thread);
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(job.group->exceptionMutex);
+			if (!job.group->exception) job.group->exception = std::current_exception();
+		}
+		queues[thread]->jobsRun.fetch_add(1, std::memory_order_relaxed);
+		job.group->remaining.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+	
+	void workerLoop(uint32_t thread) {
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wake.wait(lock, [&] { return stopping || queuedJobs != 0; });
+				if (stopping) return;
+			}
+			while (runOne(thread)) {}
+		}
+	}
+};
+
+
+/* CPU-side frame pacing. acquire-to-present is the time from asking for an image to handing it back, which is
+   what the present policy trades away; frame time is the interval between presents and its spread shows stutter.
+   a run can go on for days, so every series is kept as running moments plus a histogram, never per sample */
+class FramePacingStats {
+public:
+	void addFrame(std::chrono::steady_clock::time_point acquireStart, std::chrono::steady_clock::time_point presentEnd, double blockedMilliseconds) {
+		acquireToPresent.add(std::chrono::duration<double, std::milli>(presentEnd - acquireStart).count());
+		if (lastPresent) {
+			frameTimes.add(std::chrono::duration<double, std::milli>(presentEnd - *lastPresent).count());
+		}
+		lastPresent = presentEnd;
+		blocked.add(blockedMilliseconds);
+	}
+	
+	// an interrupted sequence (e.g. swapchain recreation) shouldn't show up as one long frame
+	void breakSequence() { lastPresent.reset(); }
+	
+	void print(std::ostream& out) const {
+		if (acquireToPresent.count == 0) return;
+		out << "frame pacing over " << acquireToPresent.count << " frames (ms):\n";
+		acquireToPresent.print(out, "acquire-to-present");
+		frameTimes.print(out, "frame time");
+		blocked.print(out, "blocked on GPU");
+	}
+	
+private:
+	/* log-spaced buckets, BUCKETS_PER_OCTAVE per doubling starting at 1us, so a percentile is off by at most
+	   ~1% of its value at any scale. the last bucket takes everything from ~16s up */
+	static constexpr uint32_t BUCKETS_PER_OCTAVE = 32;
+	static constexpr uint32_t BUCKET_COUNT = BUCKETS_PER_OCTAVE * 24;
+	
+	struct Series {
+		uint64_t count = 0;
+		double mean = 0.0;
+		double m2 = 0.0; // sum of squared differences from the mean, Welford's update
+		double min = 0.0;
+		double max = 0.0;
+		std::vector<uint64_t> buckets = std::vector<uint64_t>(BUCKET_COUNT, 0);
+		
+		void add(double milliseconds) {
+			++count;
+			double delta = milliseconds - mean;
+			mean += delta / count;
+			m2 += delta * (milliseconds - mean);
+			min = count == 1 ? milliseconds : std::min(min, milliseconds);
+			max = count == 1 ? milliseconds : std::max(max, milliseconds);
+			
+			double microseconds = milliseconds * 1000.0;
+			uint32_t bucket = 0;
+			if (microseconds > 1.0) {
+				double index = std::floor(std::log2(microseconds) * BUCKETS_PER_OCTAVE);
+				bucket = static_cast<uint32_t>(std::min(index, static_cast<double>(BUCKET_COUNT - 1)));
+			}
+			++buckets[bucket];
+		}
+		
+		// the geometric middle of the bucket the p-th sample falls in, clamped to what was actually seen
+		double percentile(double p) const {
+			uint64_t rank = std::min(count - 1, static_cast<uint64_t>(p * count));
+			uint64_t seen = 0;
+			uint32_t bucket = 0;
+			for ( ; bucket < BUCKET_COUNT - 1 ; ++bucket) {
+				seen += buckets[bucket];
+				if (seen > rank) break;
+			}
+			double microseconds = std::exp2((bucket + 0.5) / BUCKETS_PER_OCTAVE);
+			return std::clamp(microseconds / 1000.0, min, max);
+		}
+		
+		void print(std::ostream& out, const char *name) const {
+			if (count == 0) return;
+			out << '\t' << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+			    << " mean " << mean << "  stddev " << std::sqrt(m2 / count) << "  p50 " << percentile(0.5)
+			    << "  p95 " << percentile(0.95) << "  p99 " << percentile(0.99) << "  max " << max << '\n';
+		}
+	};
+	
+	Series acquireToPresent;
+	Series frameTimes;
+	Series blocked; // frame wait + acquire + image wait, how long the CPU sat idle because of the swapchain
+	std::optional<std::chrono::steady_clock::time_point> lastPresent;
+};
+
+
+// flat list of completed scopes; nesting is recovered from depth and timestamps
+class CpuProfiler {
+public:
+	struct Event {
+		std::string name;
+		uint32_t depth;
+		double startMicroseconds;
+		double durationMicroseconds;
+		uint64_t allocations;
+		uint64_t allocatedBytes;
+		uint64_t vulkanAllocations;     // driver allocations through HostAllocator
+		uint64_t vulkanAllocatedBytes;
+		uint32_t thread;                // 0 = the first thread that started a scope, the others in order of their first scope
+	};
+	
+	bool enabled = true;
+	
+	double now() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+	}
+	
+	const std::vector<Event>& getEvents() const { return events; }
+	
+	// GPU work measured elsewhere (GpuProfiler), already converted to this profiler's clock
+	void addGpuEvent(const std::string& name, uint32_t depth, double startMicroseconds, double durationMicroseconds) {
+		Event event{}; // no allocation counts or CPU thread for GPU work
+		event.name = name;
+		event.depth = depth;
+		event.startMicroseconds = startMicroseconds;
+		event.durationMicroseconds = durationMicroseconds;
+		gpuEvents.push_back(std::move(event));
+	}
+	
+	// allocation counts are process wide, so scopes running in parallel on other threads count each other's
+	void printSummary(std::ostream& out) const {
+		for (const auto& event : events) {
+			if (event.thread != 0) out << "[thread " << event.thread << "] ";
+			out << std::string(2 * event.depth, ' ') << event.name << " : " << event.durationMicroseconds / 1000.0 << " ms, "
+				<< event.allocations << " allocations (" << event.allocatedBytes << " bytes), "
+				<< event.vulkanAllocations << " driver allocations (" << event.vulkanAllocatedBytes << " bytes)\n";
+		}
+	}
+	
+	// the Chrome trace event format, loadable in chrome://tracing and ui.perfetto.dev
+	void writeChromeTrace(const std::string& path) const {
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open trace file: " + path);
+		}
+		file << "{\"traceEvents\":[\n";
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU (graphics queue)\"}}";
+		for (uint32_t thread = 1 ; thread < depths.size() ; ++thread) {
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 2 + thread
+			     << ",\"args\":{\"name\":\"CPU thread " << thread << "\"}}";
+		}
+		for (const Event& event : events) {
+			file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.thread == 0 ? 1 : 2 + event.thread)
+				<< ",\"ts\":" << event.startMicroseconds << ",\"dur\":" << event.durationMicroseconds
+				<< ",\"args\":{\"allocations\":" << event.allocations << ",\"allocatedBytes\":" << event.allocatedBytes
+				<< ",\"vulkanAllocations\":" << event.vulkanAllocations << ",\"vulkanAllocatedBytes\":" << event.vulkanAllocatedBytes << "}}";
+		}
+		for (const Event& event : gpuEvents) {
+			file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2"
+				<< ",\"ts\":" << event.startMicroseconds << ",\"dur\":" << event.durationMicroseconds << "}";
+		}
+		file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	}
+
+private:
+	friend class ScopedTimer;
+	
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	std::mutex mutex; // scopes may run on several threads during startup
+	std::vector<Event> events;
+	std::vector<Event> gpuEvents;
+	std::vector<std::thread::id> threads; // index = Event::thread
+	std::vector<uint32_t> depths;         // current nesting per thread
+	
+	uint32_t threadIndex() {
+		std::thread::id id = std::this_thread::get_id();
+		auto it = std::find(threads.begin(), threads.end(), id);
+		if (it != threads.end()) return static_cast<uint32_t>(it - threads.begin());
+		threads.push_back(id);
+		depths.push_back(0);
+		return static_cast<uint32_t>(threads.size() - 1);
+	}
+};
+
+class ScopedTimer {
+public:
+	ScopedTimer(CpuProfiler& profiler, const char *name) : profiler(profiler), name(name) {
+		if (!profiler.enabled) return;
+		allocationsAtStart = hostAllocationCount.load(std::memory_order_relaxed);
+		bytesAtStart = hostAllocationBytes.load(std::memory_order_relaxed);
+		vulkanAllocationsAtStart = vulkanAllocationCount.load(std::memory_order_relaxed);
+		vulkanBytesAtStart = vulkanAllocationBytes.load(std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(profiler.mutex);
+			thread = profiler.threadIndex();
+			depth = profiler.depths[thread]++;
+		}
+		start = profiler.now();
+	}
+	
+	~ScopedTimer() {
+		if (!profiler.enabled) return;
+		double end = profiler.now();
+		std::lock_guard<std::mutex> lock(profiler.mutex);
+		--profiler.depths[thread];
+		profiler.events.push_back({
+			name, depth, start, end - start,
+			hostAllocationCount.load(std::memory_order_relaxed) - allocationsAtStart,
+			hostAllocationBytes.load(std::memory_order_relaxed) - bytesAtStart,
+			vulkanAllocationCount.load(std::memory_order_relaxed) - vulkanAllocationsAtStart,
+			vulkanAllocationBytes.load(std::memory_order_relaxed) - vulkanBytesAtStart,
+			thread,
+		});
+	}
+	
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+	
+private:
+	CpuProfiler& profiler;
+	const char *name;
+	uint32_t thread = 0;
+	uint32_t depth = 0;
+	double start = 0.0;
+	uint64_t allocationsAtStart = 0;
+	uint64_t bytesAtStart = 0;
+	uint64_t vulkanAllocationsAtStart = 0;
+	uint64_t vulkanBytesAtStart = 0;
+};
+
+
+/* timestamp queries around passes on the graphics queue. every frame context has its own query pool, which
+   is read back when the context comes around again: the GPU has finished it by then, so the results are
+   there and vkGetQueryPoolResults never waits. there is no shared CPU/GPU clock in Vulkan 1.0, so each
+   frame's GPU events are placed on the CPU timeline starting at the frame's submit */
+class GpuProfiler {
+public:
+	static constexpr uint32_t MAX_SCOPES_PER_FRAME = 64;
+	
+	// debug_utils labels work without timestamps and timestamps without labels, either may be missing
+	void init(VkDevice device, const VkAllocationCallbacks *allocator, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount,
+	          PFN_vkCmdBeginDebugUtilsLabelEXT beginLabel, PFN_vkCmdEndDebugUtilsLabelEXT endLabel) {
+		this->device = device;
+		this->allocator = allocator;
+		this->timestampPeriod = timestampPeriod;
+		this->beginLabel = beginLabel;
+		this->endLabel = endLabel;
+		timestampMask = timestampValidBits >= 64 ? ~uint64_t{0} : (uint64_t{1} << timestampValidBits) - 1;
+		timestamps = timestampValidBits != 0 && timestampPeriod > 0.0f;
+		if (!timestamps) return;
+		
+		slots.resize(frameCount);
+		for (auto& slot : slots) {
+			VkQueryPoolCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			createInfo.queryCount = 2 * MAX_SCOPES_PER_FRAME;
+			if (vkCreateQueryPool(device, &createInfo, allocator, &slot.pool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create timestamp query pool");
+			}
+		}
+	}
+	
+	void destroy() {
+		for (auto& slot : slots) {
+			vkDestroyQueryPool(device, slot.pool, allocator);
+		}
+		slots.clear();
+	}
+	
+	bool hasTimestamps() const { return timestamps; }
+	
+	/* right after vkBeginCommandBuffer of the frame context's primary buffer, once its last frame was waited for.
+	   collects what the slot measured last time into the profiler, then resets its queries */
+	void beginFrame(uint32_t frameIndex, VkCommandBuffer commandBuffer, CpuProfiler *trace) {
+		if (!timestamps) return;
+		current = &slots[frameIndex];
+		collect(*current, trace);
+		vkCmdResetQueryPool(commandBuffer, current->pool, 0, 2 * MAX_SCOPES_PER_FRAME);
+		current->scopes.clear();
+		current->cpuSubmitMicroseconds = -1.0;
+	}
+	
+	// the frame's command buffer was just submitted, its GPU events start here on the CPU timeline
+	void frameSubmitted(double cpuMicroseconds) {
+		if (current) current->cpuSubmitMicroseconds = cpuMicroseconds;
+	}
+	
+	void beginScope(VkCommandBuffer commandBuffer, const char *name) {
+		if (beginLabel) {
+			VkDebugUtilsLabelEXT label{};
+			label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+			label.pLabelName = name;
+			beginLabel(commandBuffer, &label);
+		}
+		if (!current) return;
+		uint32_t index = static_cast<uint32_t>(current->scopes.size());
+		openScopes.push_back(index);
+		if (index >= MAX_SCOPES_PER_FRAME) return; // still balanced, just not measured
+		current->scopes.push_back({name, static_cast<uint32_t>(openScopes.size() - 1)});
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, current->pool, 2 * index);
+	}
+	
+	void endScope(VkCommandBuffer commandBuffer) {
+		if (current && !openScopes.empty()) {
+			uint32_t index = openScopes.back();
+			openScopes.pop_back();
+			if (index < MAX_SCOPES_PER_FRAME) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, current->pool, 2 * index + 1);
+			}
+		}
+		if (endLabel) {
+			endLabel(commandBuffer);
+		}
+	}
+	
+	void printSummary(std::ostream& out) const {
+		if (totals.empty()) return;
+		out << "GPU time per frame:\n";
+		for (const auto& [name, total] : totals) {
+			out << '\t' << name << " : " << std::fixed << std::setprecision(3) << total.milliseconds / total.count << " ms (" << total.count << " samples)\n";
+		}
+	}
+	
+private:
+	struct Scope {
+		std::string name;
+		uint32_t depth;
+	};
+	
+	struct Slot {
+		VkQueryPool pool = VK_NULL_HANDLE;
+		std::vector<Scope> scopes; // scope i wrote queries 2i and 2i + 1
+		double cpuSubmitMicroseconds = -1.0;
+	};
+	
+	struct Total {
+		double milliseconds = 0.0;
+		uint64_t count = 0;
+	};
+	
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks *allocator = nullptr;
+	float timestampPeriod = 0.0f; // nanoseconds per tick
+	uint64_t timestampMask = 0;
+	bool timestamps = false;
+	PFN_vkCmdBeginDebugUtilsLabelEXT beginLabel = nullptr;
+	PFN_vkCmdEndDebugUtilsLabelEXT endLabel = nullptr;
+	std::vector<Slot> slots;
+	Slot *current = nullptr;
+	std::vector<uint32_t> openScopes;
+	std::map<std::string, Total> totals;
+	
+	void collect(const Slot& slot, CpuProfiler *trace) {
+		if (slot.scopes.empty() || slot.cpuSubmitMicroseconds < 0.0) return;
+		std::vector<uint64_t> results(2 * slot.scopes.size());
+		VkResult result = vkGetQueryPoolResults(device, slot.pool, 0, static_cast<uint32_t>(results.size()),
+			results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) return; // VK_NOT_READY would mean the frame wait lied, just drop the frame
+		
+		uint64_t origin = results[0] & timestampMask;
+		auto microseconds = [&](uint64_t ticks) {
+			uint64_t delta = ((ticks & timestampMask) - origin) & timestampMask; // survives one wrap of the counter
+			return static_cast<double>(delta) * timestampPeriod / 1000.0;
+		};
+		for (size_t i = 0 ; i < slot.scopes.size() ; ++i) {
+			double start = microseconds(results[2 * i]);
+			double duration = microseconds(results[2 * i + 1]) - start;
+			Total& total = totals[slot.scopes[i].name];
+			total.milliseconds += duration / 1000.0;
+			++total.count;
+			if (trace) {
+				trace->addGpuEvent(slot.scopes[i].name, slot.scopes[i].depth, slot.cpuSubmitMicroseconds + start, duration);
+			}
+		}
+	}
+};
+
+// brackets a pass with a timestamp pair and a debug_utils label
+class GpuScope {
+public:
+	GpuScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char *name) : profiler(profiler), commandBuffer(commandBuffer) {
+		profiler.beginScope(commandBuffer, name);
+	}
+	~GpuScope() {
+		profiler.endScope(commandBuffer);
+	}
+	
+	GpuScope(const GpuScope&) = delete;
+	GpuScope& operator=(const GpuScope&) = delete;
+	
+private:
+	GpuProfiler& profiler;
+	VkCommandBuffer commandBuffer;
+};
+
+
+/* validation messages arrive on whatever thread made the Vulkan call. the callback only counts, rate limits
+   and copies the message into a bounded lock-free ring; a writer thread formats and prints it. repeats of a
+   message id (number and name) beyond MESSAGES_PER_ID_PER_SECOND are counted but not queued, and whatever doesn't fit in
+   the ring is dropped and counted, so a flood can never block the caller */
+class ValidationSink {
+public:
+	static constexpr uint32_t RING_SIZE = 256;           // power of two
+	static constexpr uint32_t ID_TABLE_SIZE = 1024;      // power of two, distinct message ids we keep counts for
+	static constexpr uint32_t MESSAGES_PER_ID_PER_SECOND = 5;
+	static constexpr size_t MAX_MESSAGE_LENGTH = 1024;
+	
+	ValidationSink() {
+		for (uint32_t i = 0 ; i < RING_SIZE ; ++i) {
+			ring[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	
+	~ValidationSink() { stop(); }
+	
+	void start(std::ostream& out) {
+		this->out = &out;
+		running.store(true);
+		writer = std::thread([this] { writerLoop(); });
+	}
+	
+	// drains what's queued, then prints the summary
+	void stop() {
+		if (!writer.joinable()) return;
+		running.store(false);
+		pending.fetch_add(1, std::memory_order_release);
+		wake.notify_one();
+		writer.join();
+		printSummary(*out);
+	}
+	
+	// called from the debug messenger callback, never blocks or allocates
+	void push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT *data) {
+		severityCounts[severityIndex(severity)].fetch_add(1, std::memory_order_relaxed);
+		for (uint32_t bit = 0 ; bit < TYPE_COUNT ; ++bit) {
+			if (type & (1u << bit)) typeCounts[bit].fetch_add(1, std::memory_order_relaxed);
+		}
+		
+		IdEntry *entry = findId(data->messageIdNumber, data->pMessageIdName);
+		if (entry) {
+			entry->count.fetch_add(1, std::memory_order_relaxed);
+			if (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) entry->performance.store(true, std::memory_order_relaxed);
+			if (!admit(*entry)) {
+				suppressed.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+		}
+		
+		// bounded MPMC queue (Vyukov): claim a slot by advancing tail, publish by bumping its sequence
+		uint64_t position = tail.load(std::memory_order_relaxed);
+		Slot *slot;
+		for (;;) {
+			slot = &ring[position & (RING_SIZE - 1)];
+			uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+			int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+			if (difference == 0) {
+				if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			} else if (difference < 0) {
+				dropped.fetch_add(1, std::memory_order_relaxed); // writer is RING_SIZE messages behind
+				return;
+			} else {
+				position = tail.load(std::memory_order_relaxed);
+			}
+		}
+		slot->severity = severity;
+		slot->type = type;
+		slot->idNumber = data->messageIdNumber;
+		copyTruncated(slot->idName, data->pMessageIdName, sizeof(slot->idName));
+		copyTruncated(slot->text, data->pMessage, sizeof(slot->text));
+		slot->sequence.store(position + 1, std::memory_order_release);
+		
+		pending.fetch_add(1, std::memory_order_release);
+		wake.notify_one();
+	}
+	
+	uint64_t errorCount() const { return severityCounts[3].load(std::memory_order_relaxed); }
+	
+	// performance warnings by message id, the counts include suppressed repeats
+	std::vector<std::pair<std::string, uint64_t>> performanceWarnings() const {
+		std::vector<std::pair<std::string, uint64_t>> warnings;
+		for (const auto& entry : ids) {
+			if (entry.used.load(std::memory_order_acquire) && entry.performance.load(std::memory_order_relaxed)) {
+				warnings.emplace_back(entry.name, entry.count.load(std::memory_order_relaxed));
+			}
+		}
+		std::sort(warnings.begin(), warnings.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		return warnings;
+	}
+	
+private:
+	static constexpr uint32_t TYPE_COUNT = 3; // general, validation, performance
+	
+	struct Slot {
+		std::atomic<uint64_t> sequence{0};
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+		VkDebugUtilsMessageTypeFlagsEXT type;
+		int32_t idNumber;
+		char idName[128];
+		char text[MAX_MESSAGE_LENGTH];
+	};
+	
+	struct IdEntry {
+		std::atomic<bool> used{false};
+		std::atomic<bool> ready{false}; // id and name written
+		int32_t id = 0;
+		char name[128] = {};
+		std::atomic<uint64_t> count{0};
+		std::atomic<int64_t> windowStart{0}; // milliseconds
+		std::atomic<uint32_t> windowCount{0};
+		std::atomic<bool> performance{false};
+	};
+	
+	std::array<Slot, RING_SIZE> ring;
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> tail{0};
+	std::atomic<uint32_t> pending{0};
+	std::mutex wakeMutex;            // only the writer takes it, producers notify without it
+	std::condition_variable wake;
+	std::array<IdEntry, ID_TABLE_SIZE> ids;
+	std::array<std::atomic<uint64_t>, 4> severityCounts{};    // verbose, info, warning, error
+	std::array<std::atomic<uint64_t>, TYPE_COUNT> typeCounts{};
+	std::atomic<uint64_t> suppressed{0};
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<bool> running{false};
+	std::thread writer;
+	std::ostream *out = &std::cerr;
+	std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	
+	static uint32_t severityIndex(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) return 3;
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) return 2;
+		if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) return 1;
+		return 0;
+	}
+	
+	static void copyTruncated(char *destination, const char *source, size_t capacity) {
+		if (!source) source = "";
+		size_t length = std::min(std::strlen(source), capacity - 1);
+		std::memcpy(destination, source, length);
+		destination[length] = '\0';
+	}
+	
+	/* open addressing on id and name, entries are claimed once and never removed. nullptr when the table is full.
+	   the name counts too since messages without an id (0, e.g. everything from the loader) would share one entry */
+	IdEntry* findId(int32_t id, const char *name) {
+		if (!name) name = "";
+		uint32_t hash = static_cast<uint32_t>(id) * 2654435761u;
+		for (const char *c = name ; *c && c < name + sizeof(IdEntry::name) - 1 ; ++c) {
+			hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u; // FNV-1a over what the entry keeps of the name
+		}
+		for (uint32_t probe = 0 ; probe < ID_TABLE_SIZE ; ++probe) {
+			IdEntry& entry = ids[(hash + probe) & (ID_TABLE_SIZE - 1)];
+			if (!entry.used.load(std::memory_order_acquire)) {
+				bool expected = false;
+				if (entry.used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+					entry.id = id;
+					copyTruncated(entry.name, name, sizeof(entry.name));
+					entry.ready.store(true, std::memory_order_release);
+					return &entry;
+				}
+			}
+			while (!entry.ready.load(std::memory_order_acquire)) {} // another thread is filling it in right now
+			if (entry.id == id && std::strncmp(entry.name, name, sizeof(entry.name) - 1) == 0) return &entry;
+		}
+		return nullptr;
+	}
+	
+	// at most MESSAGES_PER_ID_PER_SECOND per id per one second window, racing threads may let one extra through
+	bool admit(IdEntry& entry) {
+		int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - origin).count();
+		int64_t windowStart = entry.windowStart.load(std::memory_order_relaxed);
+		if (now - windowStart >= 1000 && entry.windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed)) {
+			entry.windowCount.store(0, std::memory_order_relaxed);
+		}
+		return entry.windowCount.fetch_add(1, std::memory_order_relaxed) < MESSAGES_PER_ID_PER_SECOND;
+	}
+	
+	void writerLoop() {
+		for (;;) {
+			{
+				// a notify that slips in between the predicate check and the wait is lost, the timeout bounds how long that delays us
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return pending.load(std::memory_order_acquire) != 0; });
+			}
+			// producers bump pending after publishing, so anything still being written will wake us again
+			pending.exchange(0, std::memory_order_acq_rel);
+			bool wrote = false;
+			while (drainOne()) wrote = true;
+			if (wrote) out->flush();
+			if (!running.load()) return;
+		}
+	}
+	
+	bool drainOne() {
+		uint64_t position = head.load(std::memory_order_relaxed);
+		Slot& slot = ring[position & (RING_SIZE - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != position + 1) return false;
+		
+		static const char *severityNames[] = {"verbose", "info", "warning", "error"};
+		*out << "validation " << severityNames[severityIndex(slot.severity)]
+		     << ((slot.type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) ? " [performance]" : "")
+		     << " (" << slot.idName << ", " << slot.idNumber << "): " << slot.text << '\n';
+		
+		slot.sequence.store(position + RING_SIZE, std::memory_order_release);
+		head.store(position + 1, std::memory_order_relaxed);
+		return true;
+	}
+	
+	void printSummary(std::ostream& out) const {
+		out << "validation messages: " << severityCounts[3] << " errors, " << severityCounts[2] << " warnings, "
+		    << severityCounts[1] << " info, " << severityCounts[0] << " verbose; " << typeCounts[0] << " general, "
+		    << typeCounts[1] << " validation, " << typeCounts[2] << " performance; " << suppressed << " repeats suppressed, "
+		    << dropped << " dropped\n";
+		for (const auto& [name, count] : performanceWarnings()) {
+			out << "\tperformance warning " << name << " : " << count << '\n';
+		}
+	}
+};
+
+
+VkResult createDebugUtilsMessengerEXT(
+	VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+	const VkAllocationCallbacks *pAllocator, VkDebugUtilsMessengerEXT *pDebugMessenger) {
+		
+	auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+	VkResult result;
+	if (func != nullptr) {
+		result = func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+	} else { 
+		result = VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
+	return result;
+}
+
+static std::vector<char> readFile(const std::string& filename) {
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file: " + filename);
+	}
+	
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<char> buffer(fileSize);
+	file.seekg(0);
+	file.read(buffer.data(), fileSize);
+	return buffer;
+}
+
+/* reads files on a background thread ahead of the code that needs them. read() hands out what was read, and
+   reads the file itself if it wasn't prefetched; an error reading it ahead is thrown from read() as if read then */
+class FilePrefetcher {
+public:
+	~FilePrefetcher() { join(); }
+	
+	// pageIn files are only pulled into the page cache, for whoever maps them later
+	void start(const std::vector<std::string>& paths, const std::vector<std::string>& pageIn) {
+		std::vector<std::promise<std::vector<char>>> promises(paths.size());
+		for (size_t i = 0 ; i < paths.size() ; ++i) {
+			files.emplace(paths[i], promises[i].get_future().share());
+		}
+		worker = std::thread([paths, pageIn, promises = std::move(promises)]() mutable {
+			for (size_t i = 0 ; i < paths.size() ; ++i) {
+				try {
+					promises[i].set_value(readFile(paths[i]));
+				} catch (...) {
+					promises[i].set_exception(std::current_exception());
+				}
+			}
+			for (const auto& path : pageIn) {
+				int fd = open(path.c_str(), O_RDONLY);
+				if (fd < 0) continue; // whoever opens it for real reports the error
+				posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+				close(fd);
+			}
+		});
+	}
+	
+	void join() {
+		if (worker.joinable()) worker.join();
+	}
+	
+	// safe from any thread once start() has returned
+	std::vector<char> read(const std::string& path) const {
+		auto it = files.find(path);
+		if (it == files.end()) return readFile(path);
+		return it->second.get();
+	}
+	
+private:
+	std::unordered_map<std::string, std::shared_future<std::vector<char>>> files;
+	std::thread worker;
+};
+
+// Vulkan enumerates extensions and layers as plain arrays, this is for checking many names against one
+template <typename Properties, size_t N>
+static std::unordered_set<std::string> nameSet(const std::vector<Properties>& properties, char (Properties::*name)[N]) {
+	std::unordered_set<std::string> names;
+	names.reserve(properties.size());
+	for (const auto& entry : properties) {
+		names.emplace(entry.*name);
+	}
+	return names;
+}
+
+VkResult createHeadlessSurfaceEXT(
+	VkInstance instance, const VkHeadlessSurfaceCreateInfoEXT *pCreateInfo,
+	const VkAllocationCallbacks *pAllocator, VkSurfaceKHR *pSurface) {
+		
+	auto func = (PFN_vkCreateHeadlessSurfaceEXT) vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+	VkResult result;
+	if (func != nullptr) {
+		result = func(instance, pCreateInfo, pAllocator, pSurface);
+	} else { 
+		result = VK_ERROR_EXTENSION_NOT_PRESENT;
+	}
+	return result;
+}
+
+void destroyDebugUtilsMessengerEXT(VkInstance instance, 
+	VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks *pAllocator) {
+		
+	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+	
+	func(instance, debugMessenger, pAllocator);
+}
+
+
+/* binary mesh file: a header, then the vertex and index sections, each starting at a multiple of
+   MESH_SECTION_ALIGNMENT so they can be copied straight out of a mapping of the file.
+   written by --convert-mesh, positions are fitted into [-1, 1] so the mesh fills the screen without a camera */
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+};
+
+struct MeshFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t vertexStride; // sizeof(MeshVertex), the only layout there is so far
+	uint32_t indexCount;
+	uint32_t indexSize;    // 2 or 4 bytes, 2 whenever the vertex count allows it
+	uint64_t vertexOffset; // from the start of the file
+	uint64_t indexOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+static constexpr uint32_t MESH_FILE_MAGIC = 0x534d5456; // "VTMS"
+static constexpr uint32_t MESH_FILE_VERSION = 1;
+static constexpr uint64_t MESH_SECTION_ALIGNMENT = 256; // covers nonCoherentAtomSize and cache lines everywhere we know of
+
+// read-only mapping of a whole file
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("failed to open file: " + path);
+		}
+		struct stat status;
+		if (fstat(fd, &status) != 0) {
+			::close(fd);
+			throw std::runtime_error("failed to stat file: " + path);
+		}
+		length = static_cast<size_t>(status.st_size);
+		if (length != 0) {
+			mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		::close(fd); // the mapping keeps the file referenced
+		if (mapping == MAP_FAILED) {
+			mapping = nullptr;
+			throw std::runtime_error("failed to map file: " + path);
+		}
+		if (mapping) {
+			madvise(mapping, length, MADV_SEQUENTIAL); // read once front to back, lets the kernel read ahead and drop behind
+		}
+	}
+	
+	~MappedFile() {
+		if (mapping) munmap(mapping, length);
+	}
+	
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	
+	const char* data() const { return static_cast<const char*>(mapping); }
+	size_t size() const { return length; }
+	
+private:
+	void *mapping = nullptr;
+	size_t length = 0;
+};
+
+// a mapped, validated mesh file. the sections point into the mapping, nothing is copied until the caller does
+class MeshFile {
+public:
+	explicit MeshFile(const std::string& path) : file(path) {
+		if (file.size() < sizeof(MeshFileHeader)) {
+			throw std::runtime_error("not a mesh file: " + path);
+		}
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (header.magic != MESH_FILE_MAGIC || header.version != MESH_FILE_VERSION) {
+			throw std::runtime_error("not a mesh file or wrong version: " + path);
+		}
+		if (header.vertexStride != sizeof(MeshVertex) || (header.indexSize != 2 && header.indexSize != 4) ||
+		    header.vertexOffset % MESH_SECTION_ALIGNMENT != 0 || header.indexOffset % MESH_SECTION_ALIGNMENT != 0 ||
+		    !fits(header.vertexOffset, vertexBytes()) || !fits(header.indexOffset, indexBytes())) {
+			throw std::runtime_error("corrupt mesh file: " + path);
+		}
+	}
+	
+	const MeshFileHeader& getHeader() const { return header; }
+	const char* vertexData() const { return file.data() + header.vertexOffset; }
+	const char* indexData() const { return file.data() + header.indexOffset; }
+	uint64_t vertexBytes() const { return sectionBytes(header.vertexCount, header.vertexStride); }
+	uint64_t indexBytes() const { return sectionBytes(header.indexCount, header.indexSize); }
+	
+private:
+	static uint64_t sectionBytes(uint64_t count, uint64_t elementSize) {
+		if (elementSize != 0 && count > std::numeric_limits<uint64_t>::max() / elementSize) {
+			throw std::runtime_error("corrupt mesh file: section size overflows");
+		}
+		return count * elementSize;
+	}
+	
+	// written so a crafted offset can't wrap around and pass
+	bool fits(uint64_t offset, uint64_t bytes) const {
+		return offset <= file.size() && bytes <= file.size() - offset;
+	}
+	
+	MappedFile file;
+	MeshFileHeader header;
+};
+
+// the text format we convert from, and the baseline the binary format is measured against
+struct ObjMesh {
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+/* positions, normals and faces of a Wavefront OBJ, polygons are triangulated as fans. vertices are shared
+   between faces that use the same position/normal pair. meshes without normals get zero normals */
+static ObjMesh loadObj(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file: " + path);
+	}
+	
+	std::vector<std::array<float, 3>> positions;
+	std::vector<std::array<float, 3>> normals;
+	std::unordered_map<uint64_t, uint32_t> vertexByKey; // position index << 32 | normal index + 1
+	ObjMesh mesh;
+	
+	// OBJ indices are 1-based, negative ones count back from the latest element
+	auto resolve = [&](long index, size_t count) -> size_t {
+		long resolved = index < 0 ? static_cast<long>(count) + index : index - 1;
+		if (resolved < 0 || static_cast<size_t>(resolved) >= count) {
+			throw std::runtime_error("index out of range in " + path);
+		}
+		return static_cast<size_t>(resolved);
+	};
+	
+	std::string line;
+	std::vector<uint32_t> face;
+	while (std::getline(file, line)) {
+		const char *cursor = line.c_str();
+		if (line.compare(0, 2, "v ") == 0 || line.compare(0, 3, "vn ") == 0) {
+			bool normal = line[1] == 'n';
+			cursor += normal ? 3 : 2;
+			std::array<float, 3> value{};
+			for (auto& component : value) {
+				char *end;
+				component = std::strtof(cursor, &end);
+				cursor = end;
+			}
+			(normal ? normals : positions).push_back(value);
+		} else if (line.compare(0, 2, "f ") == 0) {
+			cursor += 2;
+			face.clear();
+			for (;;) {
+				char *end;
+				long position = std::strtol(cursor, &end, 10);
+				if (end == cursor) break;
+				cursor = end;
+				long normal = 0;
+				if (*cursor == '/') {
+					++cursor;
+					std::strtol(cursor, &end, 10); // texture coordinate, unused
+					cursor = end;
+					if (*cursor == '/') {
+						++cursor;
+						normal = std::strtol(cursor, &end, 10);
+						cursor = end;
+					}
+				}
+				
+				size_t positionIndex = resolve(position, positions.size());
+				size_t normalIndex = normal != 0 ? resolve(normal, normals.size()) + 1 : 0;
+				uint64_t key = (uint64_t(positionIndex) << 32) | normalIndex;
+				auto [it, inserted] = vertexByKey.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+				if (inserted) {
+					MeshVertex vertex{};
+					std::memcpy(vertex.position, positions[positionIndex].data(), sizeof(vertex.position));
+					if (normalIndex != 0) std::memcpy(vertex.normal, normals[normalIndex - 1].data(), sizeof(vertex.normal));
+					mesh.vertices.push_back(vertex);
+				}
+				face.push_back(it->second);
+			}
+			for (size_t i = 2 ; i < face.size() ; ++i) {
+				mesh.indices.insert(mesh.indices.end(), {face[0], face[i - 1], face[i]});
+			}
+		}
+	}
+	return mesh;
+}
+
+// --convert-mesh: the offline step, OBJ in, mesh file out
+static void convertObjToMesh(const std::string& objPath, const std::string& meshPath) {
+	ObjMesh mesh = loadObj(objPath);
+	if (mesh.vertices.empty() || mesh.indices.empty()) {
+		throw std::runtime_error("no triangles in " + objPath);
+	}
+	
+	MeshFileHeader header{};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	header.vertexStride = sizeof(MeshVertex);
+	header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	header.indexSize = mesh.vertices.size() <= std::numeric_limits<uint16_t>::max() ? 2 : 4;
+	
+	// fit into [-1, 1] keeping the aspect ratio
+	float low[3], high[3];
+	for (int axis = 0 ; axis < 3 ; ++axis) {
+		low[axis] = std::numeric_limits<float>::max();
+		high[axis] = std::numeric_limits<float>::lowest();
+		for (const auto& vertex : mesh.vertices) {
+			low[axis] = std::min(low[axis], vertex.position[axis]);
+			high[axis] = std::max(high[axis], vertex.position[axis]);
+		}
+	}
+	float extent = std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2], 1e-6f});
+	for (auto& vertex : mesh.vertices) {
+		for (int axis = 0 ; axis < 3 ; ++axis) {
+			vertex.position[axis] = (vertex.position[axis] - (low[axis] + high[axis]) * 0.5f) * 2.0f / extent;
+		}
+	}
+	for (int axis = 0 ; axis < 3 ; ++axis) {
+		header.boundsMin[axis] = (low[axis] - (low[axis] + high[axis]) * 0.5f) * 2.0f / extent;
+		header.boundsMax[axis] = -header.boundsMin[axis];
+	}
+	
+	auto alignUp = [](uint64_t value) { return (value + MESH_SECTION_ALIGNMENT - 1) / MESH_SECTION_ALIGNMENT * MESH_SECTION_ALIGNMENT; };
+	header.vertexOffset = alignUp(sizeof(header));
+	header.indexOffset = alignUp(header.vertexOffset + mesh.vertices.size() * sizeof(MeshVertex));
+	
+	std::ofstream file(meshPath, std::ios::binary | std::ios::trunc);
+	auto padTo = [&](uint64_t offset) {
+		static const char zeros[MESH_SECTION_ALIGNMENT]{};
+		file.write(zeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(file.tellp())));
+	};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	padTo(header.vertexOffset);
+	file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(MeshVertex));
+	padTo(header.indexOffset);
+	if (header.indexSize == 2) {
+		std::vector<uint16_t> narrow(mesh.indices.begin(), mesh.indices.end());
+		file.write(reinterpret_cast<const char*>(narrow.data()), narrow.size() * sizeof(uint16_t));
+	} else {
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+	}
+	if (!file.good()) {
+		throw std::runtime_error("failed to write " + meshPath);
+	}
+	std::cout << "converted " << objPath << " to " << meshPath << ": " << header.vertexCount << " vertices, "
+	          << header.indexCount / 3 << " triangles, " << header.indexSize * 8 << "-bit indices\n";
+}
+
+/* --bench-mesh: loads the same mesh from OBJ and from the mesh file into one preallocated buffer standing in
+   for mapped staging memory, and reports time, throughput and heap traffic of each. the first repetition 
+   reads the files into the page cache, the best time is the warm one */
+static void benchmarkMeshLoad(const std::string& objPath, const std::string& meshPath, uint32_t repetitions, std::ostream& out) {
+	struct Result {
+		double bestMilliseconds = std::numeric_limits<double>::max();
+		double totalMilliseconds = 0.0;
+		uint64_t payloadBytes = 0;
+		uint64_t heapBytes = 0; // per load
+	};
+	
+	std::vector<char> staging;
+	{
+		MeshFile mesh(meshPath);
+		staging.resize(std::max<uint64_t>(mesh.vertexBytes() + mesh.indexBytes(), 1));
+	}
+	
+	auto measure = [&](Result& result, auto load) {
+		for (uint32_t i = 0 ; i < repetitions ; ++i) {
+			uint64_t heapBefore = hostAllocationBytes.load();
+			auto start = std::chrono::steady_clock::now();
+			result.payloadBytes = load();
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			result.heapBytes = hostAllocationBytes.load() - heapBefore;
+			result.bestMilliseconds = std::min(result.bestMilliseconds, milliseconds);
+			result.totalMilliseconds += milliseconds;
+		}
+	};
+	
+	Result text, binary;
+	measure(text, [&] {
+		ObjMesh mesh = loadObj(objPath);
+		uint64_t vertexBytes = mesh.vertices.size() * sizeof(MeshVertex);
+		uint64_t indexBytes = mesh.indices.size() * sizeof(uint32_t);
+		if (staging.size() < vertexBytes + indexBytes) staging.resize(vertexBytes + indexBytes); // 32-bit indices, unlike the file
+		std::memcpy(staging.data(), mesh.vertices.data(), vertexBytes);
+		std::memcpy(staging.data() + vertexBytes, mesh.indices.data(), indexBytes);
+		return vertexBytes + indexBytes;
+	});
+	measure(binary, [&] {
+		MeshFile mesh(meshPath);
+		std::memcpy(staging.data(), mesh.vertexData(), mesh.vertexBytes());
+		std::memcpy(staging.data() + mesh.vertexBytes(), mesh.indexData(), mesh.indexBytes());
+		return mesh.vertexBytes() + mesh.indexBytes();
+	});
+	
+	auto print = [&](const char *name, const std::string& path, const Result& result) {
+		out << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(3)
+		    << std::filesystem::file_size(path) / 1048576.0 << " MiB on disk, best " << result.bestMilliseconds << " ms, mean "
+		    << result.totalMilliseconds / repetitions << " ms, " << std::setprecision(1)
+		    << result.payloadBytes / 1048576.0 / (result.bestMilliseconds / 1000.0) << " MiB/s, "
+		    << result.heapBytes / 1024 << " KiB heap per load\n";
+	};
+	out << "mesh load, " << repetitions << " repetitions:\n";
+	print("obj", objPath, text);
+	print("binary", meshPath, binary);
+	out << "binary is " << std::setprecision(1) << text.bestMilliseconds / binary.bestMilliseconds << "x faster\n";
+}
+
+
+/* samples per named metric for --bench. warm-up repetitions run but aren't recorded, so caches, lazy driver
+   state and the first page faults stay out of the numbers. the JSON has one metric per line, which is what
+   compare() reads back, so a baseline is just an earlier run's output */
+class BenchmarkSuite {
+public:
+	enum class Better { Lower, Higher };
+	
+	struct Metric {
+		std::string name;
+		std::string unit;
+		Better better;
+		std::vector<double> samples;
+		
+		double mean() const {
+			double sum = 0.0;
+			for (double sample : samples) sum += sample;
+			return samples.empty() ? 0.0 : sum / samples.size();
+		}
+		
+		double stddev() const { // sample standard deviation
+			if (samples.size() < 2) return 0.0;
+			double average = mean(), sum = 0.0;
+			for (double sample : samples) sum += (sample - average) * (sample - average);
+			return std::sqrt(sum / (samples.size() - 1));
+		}
+		
+		double median() const {
+			std::vector<double> sorted = samples;
+			std::sort(sorted.begin(), sorted.end());
+			return sorted.empty() ? 0.0 : sorted[sorted.size() / 2];
+		}
+	};
+	
+	BenchmarkSuite(uint32_t warmup, uint32_t repetitions) : warmup(warmup), repetitions(std::max(repetitions, 1u)) {}
+	
+	uint32_t warmupCount() const { return warmup; }
+	uint32_t repetitionCount() const { return repetitions; }
+	void setDevice(const std::string& name) { device = name; }
+	
+	void add(const std::string& name, const char *unit, Better better, double sample) {
+		metric(name, unit, better).samples.push_back(sample);
+	}
+	
+	// calls sample() warmupCount() + repetitionCount() times, it returns one measurement in unit
+	template<typename Sample>
+	void measure(const std::string& name, const char *unit, Better better, Sample sample) {
+		for (uint32_t i = 0 ; i < warmup ; ++i) {
+			sample();
+		}
+		for (uint32_t i = 0 ; i < repetitions ; ++i) {
+			add(name, unit, better, sample());
+		}
+	}
+	
+	void writeJson(std::ostream& out) const {
+		out << std::setprecision(6) << std::defaultfloat;
+		out << "{\n\"device\": " << jsonString(device) << ",\n\"warmup\": " << warmup << ",\n\"repetitions\": " << repetitions << ",\n\"metrics\": [\n";
+		for (size_t i = 0 ; i < metrics.size() ; ++i) {
+			const Metric& m = metrics[i];
+			out << "{\"name\": " << jsonString(m.name) << ", \"unit\": " << jsonString(m.unit) << ", \"better\": \"" << (m.better == Better::Lower ? "lower" : "higher")
+			    << "\", \"mean\": " << m.mean() << ", \"stddev\": " << m.stddev() << ", \"median\": " << m.median()
+			    << ", \"min\": " << *std::min_element(m.samples.begin(), m.samples.end())
+			    << ", \"max\": " << *std::max_element(m.samples.begin(), m.samples.end())
+			    << ", \"count\": " << m.samples.size() << ", \"samples\": [";
+			for (size_t j = 0 ; j < m.samples.size() ; ++j) {
+				out << (j ? ", " : "") << m.samples[j];
+			}
+			out << "]}" << (i + 1 < metrics.size() ? "," : "") << '\n';
+		}
+		out << "]\n}\n";
+	}
+	
+	void printSummary(std::ostream& out) const {
+		out << "benchmarks on " << device << ", " << warmup << " warm-up + " << repetitions << " repetitions:\n";
+		for (const Metric& m : metrics) {
+			double mean = m.mean();
+			out << '\t' << std::left << std::setw(28) << m.name << std::right << std::fixed << std::setprecision(3)
+			    << " mean " << mean << ' ' << m.unit << "  stddev " << m.stddev() << "  median " << m.median()
+			    << "  cv " << std::setprecision(1) << (mean != 0.0 ? 100.0 * m.stddev() / std::fabs(mean) : 0.0) << "%\n";
+		}
+	}
+	
+	/* against a JSON file written by writeJson(). a metric regressed when its mean got worse by more than
+	   tolerance (a fraction) and by more than twice the standard error of the difference, so a noisy metric
+	   needs a bigger move. a baseline from another device says nothing about this one, so that throws unless
+	   allowDeviceMismatch. returns the number of regressions */
+	uint32_t compare(const std::string& baselinePath, double tolerance, bool allowDeviceMismatch, std::ostream& out) const {
+		std::ifstream file(baselinePath);
+		if (!file.is_open()) {
+			throw std::runtime_error("failed to open benchmark baseline: " + baselinePath);
+		}
+		uint32_t regressions = 0;
+		std::string line;
+		out << "compared to " << baselinePath << ":\n";
+		while (std::getline(file, line)) {
+			std::string baselineDevice = stringField(line, "device");
+			if (!baselineDevice.empty() && baselineDevice != device) {
+				if (!allowDeviceMismatch) {
+					throw std::runtime_error("benchmark baseline was measured on " + baselineDevice + ", this run on " + device
+					                         + " (--bench-allow-device-mismatch to compare anyway)");
+				}
+				out << "\twarning: the baseline was measured on " << baselineDevice << '\n';
+			}
+			std::string name = stringField(line, "name");
+			if (name.empty()) continue;
+			auto current = std::find_if(metrics.begin(), metrics.end(), [&](const Metric& m) { return m.name == name; });
+			if (current == metrics.end()) {
+				out << '\t' << std::left << std::setw(28) << name << std::right << " not measured in this run\n";
+				continue;
+			}
+			double baseMean = numberField(line, "mean");
+			double baseStddev = numberField(line, "stddev");
+			double baseCount = std::max(numberField(line, "count"), 1.0);
+			double mean = current->mean();
+			double change = baseMean != 0.0 ? (mean - baseMean) / std::fabs(baseMean) : 0.0;
+			double worse = current->better == Better::Lower ? change : -change;
+			double standardError = std::sqrt(baseStddev * baseStddev / baseCount
+			                                 + current->stddev() * current->stddev() / current->samples.size());
+			bool regressed = worse > tolerance && std::fabs(mean - baseMean) > 2.0 * standardError;
+			regressions += regressed;
+			out << '\t' << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+			    << ' ' << baseMean << " -> " << mean << ' ' << current->unit << " (" << std::showpos << std::setprecision(1)
+			    << 100.0 * change << std::noshowpos << "%)" << (regressed ? "  REGRESSION" : "") << '\n';
+		}
+		return regressions;
+	}
+	
+private:
+	uint32_t warmup;
+	uint32_t repetitions;
+	std::string device;
+	std::vector<Metric> metrics; // in the order they were first measured
+	
+	Metric& metric(const std::string& name, const char *unit, Better better) {
+		auto it = std::find_if(metrics.begin(), metrics.end(), [&](const Metric& m) { return m.name == name; });
+		if (it != metrics.end()) return *it;
+		metrics.push_back(Metric{name, unit, better, {}});
+		return metrics.back();
+	}
+	
+	// quoted and escaped, device names come from the driver and may hold anything
+	static std::string jsonString(const std::string& value) {
+		std::string quoted = "\"";
+		for (char c : value) {
+			if (c == '"' || c == '\\') {
+				quoted += '\\';
+				quoted += c;
+			} else if (static_cast<unsigned char>(c) < 0x20) {
+				const char *hex = "0123456789abcdef";
+				quoted += "\\u00";
+				quoted += hex[c >> 4];
+				quoted += hex[c & 0xf];
+			} else {
+				quoted += c; // UTF-8 passes through as is
+			}
+		}
+		return quoted + '"';
+	}
+	
+	// "key": "value" on one line of writeJson()'s output with jsonString()'s escapes undone, empty if it's not there
+	static std::string stringField(const std::string& line, const std::string& key) {
+		std::string pattern = "\"" + key + "\": \"";
+		size_t start = line.find(pattern);
+		if (start == std::string::npos) return {};
+		std::string value;
+		for (size_t i = start + pattern.size() ; i < line.size() ; ++i) {
+			if (line[i] == '"') return value;
+			if (line[i] != '\\' || i + 1 == line.size()) {
+				value += line[i];
+			} else if (line[++i] == 'u' && i + 4 < line.size()) {
+				value += static_cast<char>(std::stoul(line.substr(i + 1, 4), nullptr, 16));
+				i += 4;
+			} else {
+				value += line[i];
+			}
+		}
+		return {}; // unterminated
+	}
+	
+	static double numberField(const std::string& line, const std::string& key) {
+		std::string pattern = "\"" + key + "\": ";
+		size_t start = line.find(pattern);
+		if (start == std::string::npos) return 0.0;
+		return std::strtod(line.c_str() + start + pattern.size(), nullptr);
+	}
+};
+
+
+class HelloTriangleApplication {
+	
+public:
+
+	explicit HelloTriangleApplication(const AppOptions& options = {}) : options(options) {
+		allocator = options.useHostAllocator ? hostAllocator.getCallbacks() : nullptr;
+		if (enableValidationLayers) {
+			validationSink.start(std::cerr); // before vkCreateInstance, which already reports through it
+		}
+	}
+
+    void run() {
+		startupBegin = std::chrono::steady_clock::now();
+		{
+			ScopedTimer timer{profiler, "startup"};
+			if (options.fastStart) {
+				initParallel();
+			} else {
+				initWindow();
+				initVulkan();
+			}
+		}
+		reportStartupProfile();
+        mainLoop();
+        cleanup();
+    }
+	
+	// from run() until the first frame was handed to the presentation engine, 0 before that
+	double timeToFirstFrame() const { return timeToFirstFrameMilliseconds; }
+	
+	/* --bench: startup as in run(), then the suite's measurements instead of the frame loop. instance and device
+	   creation need a fresh app per sample, so they're recorded (recordStartup) on every run while the rest
+	   only runs once (full) and repeats inside */
+	void runBenchmarks(BenchmarkSuite& suite, bool recordStartup, bool full) {
+		initWindow();
+		initVulkan();
+		profiler.enabled = false;
+		if (recordStartup) {
+			suite.add("instance_creation", "ms", BenchmarkSuite::Better::Lower, startupScopeMilliseconds("createInstance"));
+			suite.add("device_creation", "ms", BenchmarkSuite::Better::Lower, startupScopeMilliseconds("createLogicalDevice"));
+		}
+		if (full) {
+			suite.setDevice(deviceProfile.properties.deviceName);
+			pipelineManager.waitUntilBuilt(); // measure the real pipelines, not the fallback
+			benchmarkFrame(); // first frame: lazy driver state, the mesh upload's acquire
+			benchmarkSwapchainRecreation(suite);
+			DeviceMemoryAllocator::Buffer *uploaded = benchmarkUploads(suite);
+			benchmarkReadback(suite, uploaded);
+			memoryAllocator.destroyBuffer(uploaded);
+			benchmarkDrawSubmission(suite);
+		}
+		vkDeviceWaitIdle(device);
+		cleanup();
+	}
+
+private:
+
+	AppOptions options;
+	CpuProfiler profiler;
+	std::chrono::steady_clock::time_point startupBegin;
+	double timeToFirstFrameMilliseconds = 0.0;
+	std::ostringstream deferredStartupOutput; // fast start prints this after the first frame
+	FilePrefetcher files;                     // shader binaries, prefetched with fast start
+	HostAllocator hostAllocator;
+	ValidationSink validationSink;
+	const VkAllocationCallbacks *allocator = nullptr; // passed to every vkCreate*/vkDestroy*
+	DeviceMemoryAllocator memoryAllocator;
+	UploadRing uploadRing;
+	uint64_t frameCounter = 0;
+	GLFWwindow *window = nullptr;
+	VkInstance instance;
+	VkDebugUtilsMessengerEXT debugMessenger;
+	VkSurfaceKHR surface;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device;
+	DeviceQueues queues;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	bool swapchainOutOfDate = false;
+	std::vector<VkImage> swapchainImages;
+	VkFormat swapchainImageFormat;
+	VkPresentModeKHR swapchainPresentMode;
+	VkExtent2D swapchainImageExtent;
+	std::vector<VkImageView> swapchainImageViews;
+	std::vector<VkFramebuffer> swapchainFramebuffers;
+	/* present waits on the one of the image it shows. one per frame context could be signaled again while an
+	   earlier present of another image still waits on it; an image is only acquired again once its last present
+	   is done with the semaphore */
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	std::vector<uint64_t> imagesInFlight; // graphics queue value of the frame that last rendered to each swapchain image
+	VkRenderPass renderPass;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline graphicsPipeline;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	PipelineManager pipelineManager;
+	std::array<uint32_t, 3> colorModeVariants{}; // pipelineManager indices by COLOR_MODE
+	uint32_t meshVariant = 0;
+	DeviceMemoryAllocator::Buffer *meshVertexBuffer = nullptr; // only with --mesh
+	DeviceMemoryAllocator::Buffer *meshIndexBuffer = nullptr;
+	uint32_t meshIndexCount = 0;
+	VkIndexType meshIndexType = VK_INDEX_TYPE_UINT32;
+	
+	/* a replaced swapchain and whatever was built on it, kept until every frame recorded against it has finished and been presented.
+	   renderPass/pipeline are only set when the surface format changed and they had to be rebuilt as well */
+	struct RetiredSwapchain {
+		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+		std::vector<VkImageView> imageViews;
+		std::vector<VkFramebuffer> framebuffers;
+		std::vector<VkSemaphore> renderFinishedSemaphores; // presents queued on the old swapchain may still wait on them
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		std::vector<VkPipeline> variantPipelines; // built against renderPass
+		uint64_t retiredAtFrame = 0; // frames before this one may still use it
+	};
+	std::vector<RetiredSwapchain> retiredSwapchains;
+	// VK_EXT_swapchain_maintenance1: a fence per present, signaled once the presentation engine is done with it
+	struct PresentFence {
+		VkFence fence = VK_NULL_HANDLE;
+		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	};
+	std::deque<PresentFence> presentFences; // not known to be signaled yet, oldest first
+	std::vector<VkFence> freePresentFences;
+	bool presentFencesEnabled = false;
+	uint64_t framesCompleted = 0; // every frame before this one has finished on the GPU
+	uint32_t swapchainRecreations = 0;
+	FramePacingStats framePacing;
+	JobSystem jobSystem;
+	GpuProfiler gpuProfiler;
+	FrameCapture frameCapture;
+	BindlessTable bindlessTable;
+	bool instanceHasProperties2 = false; // VK_KHR_get_physical_device_properties2, needed to query descriptor indexing
+	bool instanceHasSurfaceMaintenance1 = false; // VK_EXT_surface_maintenance1, needed for present fences
+	bool bindlessEnabled = false;
+	bool timelinesEnabled = false;
+	std::vector<std::string> enabledDeviceExtensions; // required ones and whichever optional ones the device has
+	TextureStreamer textureStreamer;
+	RenderGraph renderGraph;
+	InstanceCuller instanceCuller;       // only with --instances
+	uint32_t instancedVariant = 0;
+	Mat4 cameraViewProjection;           // this frame's, for the instances
+	double recordMilliseconds = 0.0; // summed over all frames
+	
+	/* header in front of the driver's blob in the cache file. the driver validates its own header too, 
+	   but some drivers have crashed on foreign data, so we never hand it anything that doesn't match */
+	struct PipelineCacheFileHeader {
+		uint32_t magic;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+	};
+	static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505456; // "VTPC"
+	static constexpr uint32_t PIPELINE_CACHE_HEADER_VERSION = 1;
+	
+	// hits and misses as the driver reported them, compiles it said nothing about are counted apart
+	struct PipelineCacheStats {
+		size_t loadedBytes = 0;
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+		uint32_t unknown = 0;
+		double hitMilliseconds = 0.0;
+		double missMilliseconds = 0.0;
+		double unknownMilliseconds = 0.0;
+	} pipelineCacheStats;
+	
+	// everything one frame needs while the GPU may still be working on the previous ones
+	// command pools are externally synchronized, so every recording thread gets its own per frame
+	struct ThreadCommandPool {
+		VkCommandPool pool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> secondaries; // kept across resets, the first used of them are live this frame
+		uint32_t used = 0;
+	};
+	
+	struct FrameContext {
+		VkCommandPool commandPool;
+		VkCommandBuffer commandBuffer;
+		VkSemaphore imageAvailable;
+		uint64_t submittedValue = 0; // graphics queue value of the slot's last submission
+		std::vector<ThreadCommandPool> threadPools; // indexed by job system thread, empty when recording inline
+		uint64_t offscreenGeneration = 0;   // --blur: the render graph generation whose scene image this slot last rendered to
+		VkFramebuffer offscreenFramebuffer = VK_NULL_HANDLE;
+	};
+	std::vector<FrameContext> frames;
+	uint32_t currentFrame = 0;
+	
+	struct QueueFamilyIndices {
+		std::optional<uint32_t> graphicsFamily;
+		std::optional<uint32_t> presentFamily;
+		std::optional<uint32_t> transferFamily; // transfer-only if the hardware has one (DMA engine), else the best we could find
+		std::optional<uint32_t> computeFamily;  // compute without graphics if available, for async compute
+		
+		bool isComplete() const {
+			bool complete = graphicsFamily.has_value() && presentFamily.has_value();
+			return complete;
+		}
+	};
+	
+	struct SwapchainSupportDetails {
+		VkSurfaceCapabilitiesKHR capabilities;
+		std::vector<VkSurfaceFormatKHR> formats;
+		std::vector<VkPresentModeKHR> presentModes;
+	};
+	
+	// everything we ever ask a physical device, queried once in pickPhysicalDevice()
+	struct DeviceProfile {
+		VkPhysicalDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties properties{};
+		VkPhysicalDeviceFeatures features{};
+		std::vector<VkQueueFamilyProperties> queueFamilies;
+		std::vector<VkBool32> queueFamilySupportsPresent;
+		std::vector<VkExtensionProperties> extensions;
+		std::unordered_set<std::string> extensionNames; // of extensions, for lookups
+		SwapchainSupportDetails swapchainSupport{};
+		QueueFamilyIndices queueFamilyIndices;
+		bool fromDiskCache = false;
+	};
+	DeviceProfile deviceProfile; // of the picked physicalDevice
+	
+	// identifies a device + driver combination in the on-disk device cache
+	struct DeviceProfileKey {
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		
+		static DeviceProfileKey of(const VkPhysicalDeviceProperties& properties) {
+			DeviceProfileKey key{properties.vendorID, properties.deviceID, properties.driverVersion, {}};
+			std::memcpy(key.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+			return key;
+		}
+		
+		bool operator<(const DeviceProfileKey& other) const {
+			auto tied = std::tie(vendorID, deviceID, driverVersion);
+			auto otherTied = std::tie(other.vendorID, other.deviceID, other.driverVersion);
+			if (tied != otherTied) return tied < otherTied;
+			return std::memcmp(pipelineCacheUUID, other.pipelineCacheUUID, VK_UUID_SIZE) < 0;
+		}
+	};
+	static constexpr uint32_t DEVICE_CACHE_MAGIC = 0x50445456; // "VTDP"
+	static constexpr uint32_t DEVICE_CACHE_VERSION = 1;
+	
+	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
+		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+		VkDebugUtilsMessageTypeFlagsEXT messageType,
+		const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+		void *pUserData) {
+			
+		// printing here would stall whichever thread made the call, the sink's writer thread does it
+		auto app = static_cast<HelloTriangleApplication*>(pUserData);
+		app->validationSink.push(messageSeverity, messageType, pCallbackData);
+		
+		return VK_FALSE;
+	}
+
+	void initWindow() {
+		if (options.headless) return;
+		
+		ScopedTimer timer{profiler, "initWindow"};
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Tutorial", nullptr, nullptr);
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	}
+	
+	// not every platform reports VK_ERROR_OUT_OF_DATE_KHR after a resize, so we track it ourselves too
+	static void framebufferResizeCallback(GLFWwindow *window, int /*width*/, int /*height*/) {
+		auto app = static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->swapchainOutOfDate = true;
+	}
+
+    void initVulkan() {
+		ScopedTimer timer{profiler, "initVulkan"};
+		{ ScopedTimer timer{profiler, "createInstance"}; createInstance(); }
+		{ ScopedTimer timer{profiler, "setupDebugMessenger"}; setupDebugMessenger(); }
+		initDevice();
+	}
+	
+	/* the window is created on this thread, GLFW wants that, while the instance is created on another and the
+	   shader binaries and the mesh are read on a third. glfwInit() comes first since the instance needs GLFW's
+	   extension list. from the surface on everything needs both, so the rest is initDevice() as usual */
+	void initParallel() {
+		ScopedTimer timer{profiler, "initParallel"};
+		std::vector<std::string> shaders;
+		if (std::filesystem::is_directory("shaders")) {
+			for (const auto& entry : std::filesystem::directory_iterator("shaders")) {
+				if (entry.path().extension() == ".spv") shaders.push_back(entry.path().generic_string()); // small, read them all
+			}
+		}
+		std::vector<std::string> pageIn;
+		if (!options.meshPath.empty()) pageIn.push_back(options.meshPath);
+		files.start(shaders, pageIn);
+		
+		if (!options.headless) glfwInit();
+		auto instanceCreated = std::async(std::launch::async, [this] {
+			{ ScopedTimer timer{profiler, "createInstance"}; createInstance(); }
+			{ ScopedTimer timer{profiler, "setupDebugMessenger"}; setupDebugMessenger(); }
+		});
+		try {
+			initWindow();
+		} catch (...) {
+			instanceCreated.wait(); // it uses this object
+			throw;
+		}
+		instanceCreated.get();
+		initDevice();
+	}
+	
+	// everything from the surface on, once there is an instance and a window
+	void initDevice() {
+		{ ScopedTimer timer{profiler, "createSurface"}; createSurface(); }
+		{ ScopedTimer timer{profiler, "pickPhysicalDevice"}; pickPhysicalDevice(); }
+		{ ScopedTimer timer{profiler, "createLogicalDevice"}; createLogicalDevice(); }
+		{ ScopedTimer timer{profiler, "createSwapchain"}; createSwapchain(); }
+		{ ScopedTimer timer{profiler, "createImageViews"}; createImageViews(); }
+		createRenderFinishedSemaphores();
+		{ ScopedTimer timer{profiler, "createRenderPass"}; createRenderPass(); }
+		{ ScopedTimer timer{profiler, "createFramebuffers"}; createFramebuffers(); }
+		{ ScopedTimer timer{profiler, "createInstanceCuller"}; createInstanceCuller(); } // its set layout goes into the pipeline layout
+		{ ScopedTimer timer{profiler, "createGraphicsPipeline"}; createGraphicsPipeline(); }
+		{ ScopedTimer timer{profiler, "createPipelineVariants"}; createPipelineVariants(); }
+		{ ScopedTimer timer{profiler, "loadMesh"}; loadMesh(); }
+		{ ScopedTimer timer{profiler, "createFrameContexts"}; createFrameContexts(); }
+    }
+	
+	void reportStartupProfile() {
+		profiler.enabled = false; // startup only, keep the frame loop free of bookkeeping
+		if (options.startupTracePath.empty()) return;
+		
+		startupLog() << "startup profile:\n";
+		profiler.printSummary(startupLog());
+		profiler.writeChromeTrace(options.startupTracePath);
+		startupLog() << "startup trace written to " << options.startupTracePath << '\n';
+	}
+	
+	// startup messages, held back with fast start. not for the instance thread of initParallel(), it prints nothing
+	std::ostream& startupLog() {
+		return options.fastStart ? static_cast<std::ostream&>(deferredStartupOutput) : std::cout;
+	}
+	
+	// extension, layer and device listings, only without fast start
+	bool verboseStartup() const {
+		return !options.fastStart;
+	}
+	
+	// the first frame is on its way to the screen, what fast start held back can be printed now
+	void finishStartup() {
+		timeToFirstFrameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+		std::cout << deferredStartupOutput.str();
+		deferredStartupOutput.str({});
+		std::cout << "time to first frame: " << std::fixed << std::setprecision(2) << timeToFirstFrameMilliseconds << " ms"
+		          << (options.fastStart ? " (fast start)" : "") << '\n';
+	}
+	
+	void createInstance() {
+		VkResult result;
+		
+		VkApplicationInfo appInfo{};
+		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+		appInfo.pApplicationName = "Hello Triangle";
+		appInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
+		appInfo.pEngineName = "No Engine";
+		appInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
+		appInfo.apiVersion = VK_API_VERSION_1_0;
+		
+		VkInstanceCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+		createInfo.pApplicationInfo = &appInfo;		
+		
+		std::vector<VkExtensionProperties> availableExtensions = getAvailableExtensions();
+		if (verboseStartup()) {
+			std::cout << "available extensions:\n";
+			for(const auto& extension : availableExtensions) {
+				std::cout << '\t' << extension.extensionName << " : " << extension.specVersion << '\n';
+			}		
+		}
+		std::unordered_set<std::string> availableNames = nameSet(availableExtensions, &VkExtensionProperties::extensionName);
+		
+		std::vector<const char*> requiredExtensions = getRequiredExtensions();		
+		createInfo.enabledExtensionCount += requiredExtensions.size();
+		createInfo.ppEnabledExtensionNames = requiredExtensions.data();				
+		
+		checkRequiredExtensions(createInfo, availableNames);
+		
+		// optional: lets us query extended device features on a 1.0 instance
+		if (availableNames.count(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+			requiredExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size());
+			createInfo.ppEnabledExtensionNames = requiredExtensions.data();
+			instanceHasProperties2 = true;
+		}
+		// optional: VK_EXT_swapchain_maintenance1 on the device builds on it to tell when a present is done
+		if (instanceHasProperties2 && availableNames.count(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME) &&
+		    availableNames.count(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME)) {
+			requiredExtensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+			requiredExtensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+			createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size());
+			createInfo.ppEnabledExtensionNames = requiredExtensions.data();
+			instanceHasSurfaceMaintenance1 = true;
+		}
+		
+		
+		VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo{};
+		if (enableValidationLayers) {
+			checkValidationLayerSupport();
+			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+			createInfo.ppEnabledLayerNames = validationLayers.data();
+			
+			populateDebugUtilsMessengerCreateInfoEXT(messengerCreateInfo);
+			createInfo.pNext = &messengerCreateInfo;
+		}
+		
+		{
+			ScopedTimer timer{profiler, "vkCreateInstance"};
+			result = vkCreateInstance(&createInfo, allocator, &instance);		
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("vkCreateInstance() failed.");
+		}
+	}
+	
+	std::vector<VkExtensionProperties> getAvailableExtensions() {
+		ScopedTimer timer{profiler, "vkEnumerateInstanceExtensionProperties"};
+		uint32_t extensionCount = 0;
+		VkResult result = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		result = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+		return extensions;
+	}
+	
+	bool debugUtilsEnabled() const {
+		return enableValidationLayers || options.debugLabels;
+	}
+	
+	std::vector<const char*> getRequiredExtensions() {		
+		if (options.headless) {
+			std::vector<const char*> requiredExtensions = headlessExtensions;
+			if (debugUtilsEnabled()) {
+				requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			}
+			return requiredExtensions;
+		}
+		
+		uint32_t extensionCount;
+		const char** requiredExtensionNames = glfwGetRequiredInstanceExtensions(&extensionCount);
+		std::vector<const char*> requiredExtensions(requiredExtensionNames, requiredExtensionNames + extensionCount);
+		
+		if (debugUtilsEnabled()) {
+			requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+		
+		return requiredExtensions;
+	}
+	
+	// throws naming the first extension that's missing
+	void checkRequiredExtensions(const VkInstanceCreateInfo& createInfo, const std::unordered_set<std::string>& available) {
+		if (verboseStartup()) std::cout << "required extensions:\n";
+		const char *missing = nullptr;
+		for (uint32_t i = 0 ; i < createInfo.enabledExtensionCount ; ++i) {
+			const char *required = createInfo.ppEnabledExtensionNames[i];
+			bool supported = available.count(required) != 0;
+			if (verboseStartup()) std::cout << '\t' << required << " : " << (supported ? "was found" : "not found") << '\n';
+			if (!supported && !missing) missing = required;
+		}
+		if (missing) {
+			throw std::runtime_error(std::string("unsupported extension required: ") + missing);
+		}
+	}
+	
+	void checkValidationLayerSupport() {		
+		ScopedTimer timer{profiler, "checkValidationLayerSupport"};
+		uint32_t layerCount;
+		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+		std::vector<VkLayerProperties> availableLayers(layerCount);
+		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+		
+		if (verboseStartup()) {
+			std::cout << "available validation layers:\n";		
+			for (const auto& available : availableLayers) {
+				std::cout << '\t' << available.layerName << '\n';
+			}
+			std::cout << "checking validation layers:\n";
+		}
+		
+		std::unordered_set<std::string> availableNames = nameSet(availableLayers, &VkLayerProperties::layerName);
+		for (const auto& requested : validationLayers) {
+			if (verboseStartup()) std::cout << '\t' << requested << '\n';
+			if (!availableNames.count(requested)) {
+				throw std::runtime_error(std::string("unsupported validation layer requested: ") + requested);
+			}
+		}
+	}
+	
+	void setupDebugMessenger() {
+		if (!enableValidationLayers) return;
+		
+		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
+		populateDebugUtilsMessengerCreateInfoEXT(createInfo);
+		VkResult result = createDebugUtilsMessengerEXT(instance, &createInfo, allocator, &debugMessenger);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to setup debug messenger.");
+		}
+	}
+	
+	void populateDebugUtilsMessengerCreateInfoEXT(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
+		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+		createInfo.messageSeverity = /*VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | */VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+		createInfo.pfnUserCallback = debugCallback;
+		createInfo.pUserData = this;
+	}
+	
+	void createSurface() {
+		VkResult result;
+		if (options.headless) {
+			VkHeadlessSurfaceCreateInfoEXT createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+			result = createHeadlessSurfaceEXT(instance, &createInfo, allocator, &surface);
+		} else {
+			result = glfwCreateWindowSurface(instance, window, allocator, &surface);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create window surface");
+		}
+		
+		return;
+	}
+	
+	void pickPhysicalDevice() {
+		uint32_t deviceCount;
+		std::vector<VkPhysicalDevice> physicalDevices;
+		{
+			ScopedTimer timer{profiler, "vkEnumeratePhysicalDevices"};
+			VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+			physicalDevices.resize(deviceCount);
+			result = vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+		}
+		
+		std::vector<DeviceProfile> profiles;
+		{
+			ScopedTimer timer{profiler, "probeDevices"};
+			profiles = probeDevices(physicalDevices);
+		}
+		
+		if (verboseStartup()) {
+			std::cout << "Physical Devices found:\n";
+			for (const auto& profile : profiles) {
+				std::cout << '\t' << profile.properties.deviceName << (profile.fromDiskCache ? " (cached)" : "") << '\n';			
+			}
+		}
+		
+		std::multimap<int32_t, const DeviceProfile*> scores = rateDevices(profiles);
+		if (scores.empty() || scores.rbegin()->first <= 0) {
+			throw std::runtime_error("no suitable GPU found.");
+		}
+		
+		deviceProfile = *scores.rbegin()->second;
+		physicalDevice = deviceProfile.device;
+		
+		return;
+	}
+	
+	// one thread per adapter: surface queries can take milliseconds each on some drivers
+	std::vector<DeviceProfile> probeDevices(const std::vector<VkPhysicalDevice>& physicalDevices) {
+		std::map<DeviceProfileKey, DeviceProfile> diskCache = loadDeviceProfileCache();
+		
+		std::vector<std::future<DeviceProfile>> probes;
+		probes.reserve(physicalDevices.size());
+		for (const auto& device : physicalDevices) {
+			probes.push_back(std::async(std::launch::async, [this, device, &diskCache] {
+				return probeDevice(device, diskCache);
+			}));
+		}
+		
+		std::vector<DeviceProfile> profiles;
+		profiles.reserve(probes.size());
+		bool cacheIsStale = false;
+		for (auto& probe : probes) {
+			profiles.push_back(probe.get());
+			cacheIsStale |= !profiles.back().fromDiskCache;
+		}
+		
+		if (cacheIsStale) {
+			saveDeviceProfileCache(profiles);
+		}
+		return profiles;
+	}
+	
+	// runs on a worker thread, must not touch anything but the device, the surface and the read-only cache
+	DeviceProfile probeDevice(VkPhysicalDevice device, const std::map<DeviceProfileKey, DeviceProfile>& diskCache) const {
+		DeviceProfile profile{};
+		profile.device = device;
+		vkGetPhysicalDeviceProperties(device, &profile.properties);
+		
+		auto cached = diskCache.find(DeviceProfileKey::of(profile.properties));
+		if (cached != diskCache.end()) {
+			profile.features = cached->second.features;
+			profile.queueFamilies = cached->second.queueFamilies;
+			profile.extensions = cached->second.extensions;
+			profile.fromDiskCache = true;
+		} else {
+			vkGetPhysicalDeviceFeatures(device, &profile.features);
+			
+			uint32_t count;
+			vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
+			profile.queueFamilies.resize(count);
+			vkGetPhysicalDeviceQueueFamilyProperties(device, &count, profile.queueFamilies.data());
+			
+			uint32_t extensionCount;
+			vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+			profile.extensions.resize(extensionCount);
+			vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, profile.extensions.data());
+		}
+		profile.extensionNames = nameSet(profile.extensions, &VkExtensionProperties::extensionName);
+		
+		// surface support depends on this run's surface, never cached
+		profile.queueFamilySupportsPresent.resize(profile.queueFamilies.size());
+		for (uint32_t i = 0 ; i < profile.queueFamilies.size() ; ++i) {
+			VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &profile.queueFamilySupportsPresent[i]);
+			if (result != VK_SUCCESS) {
+				profile.queueFamilySupportsPresent[i] = VK_FALSE;
+			}
+		}
+		profile.queueFamilyIndices = findQueueFamilies(profile);
+		profile.swapchainSupport = querySwapchainSupport(device);
+		
+		return profile;
+	}
+	
+	std::map<DeviceProfileKey, DeviceProfile> loadDeviceProfileCache() {
+		std::map<DeviceProfileKey, DeviceProfile> cache;
+		if (options.deviceCachePath.empty()) return cache;
+		
+		std::ifstream file(options.deviceCachePath, std::ios::binary);
+		if (!file.is_open()) return cache;
+		
+		uint32_t magic = 0, version = 0, entryCount = 0;
+		file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+		file.read(reinterpret_cast<char*>(&version), sizeof(version));
+		file.read(reinterpret_cast<char*>(&entryCount), sizeof(entryCount));
+		if (!file.good() || magic != DEVICE_CACHE_MAGIC || version != DEVICE_CACHE_VERSION) {
+			startupLog() << "device cache: stale cache file discarded\n";
+			return cache;
+		}
+		
+		for (uint32_t entry = 0 ; entry < entryCount && file.good() ; ++entry) {
+			DeviceProfileKey key{};
+			DeviceProfile profile{};
+			uint32_t queueFamilyCount = 0, extensionCount = 0;
+			file.read(reinterpret_cast<char*>(&key), sizeof(key));
+			file.read(reinterpret_cast<char*>(&profile.features), sizeof(profile.features));
+			file.read(reinterpret_cast<char*>(&queueFamilyCount), sizeof(queueFamilyCount));
+			file.read(reinterpret_cast<char*>(&extensionCount), sizeof(extensionCount));
+			if (!file.good() || queueFamilyCount > 256 || extensionCount > 4096) break; // garbage, not a real device
+			profile.queueFamilies.resize(queueFamilyCount);
+			profile.extensions.resize(extensionCount);
+			file.read(reinterpret_cast<char*>(profile.queueFamilies.data()), queueFamilyCount * sizeof(VkQueueFamilyProperties));
+			file.read(reinterpret_cast<char*>(profile.extensions.data()), extensionCount * sizeof(VkExtensionProperties));
+			if (file.good()) {
+				cache.emplace(key, std::move(profile));
+			}
+		}
+		return cache;
+	}
+	
+	void saveDeviceProfileCache(const std::vector<DeviceProfile>& profiles) {
+		if (options.deviceCachePath.empty()) return;
+		
+		std::string tempPath = options.deviceCachePath + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			uint32_t entryCount = static_cast<uint32_t>(profiles.size());
+			file.write(reinterpret_cast<const char*>(&DEVICE_CACHE_MAGIC), sizeof(DEVICE_CACHE_MAGIC));
+			file.write(reinterpret_cast<const char*>(&DEVICE_CACHE_VERSION), sizeof(DEVICE_CACHE_VERSION));
+			file.write(reinterpret_cast<const char*>(&entryCount), sizeof(entryCount));
+			for (const auto& profile : profiles) {
+				DeviceProfileKey key = DeviceProfileKey::of(profile.properties);
+				uint32_t queueFamilyCount = static_cast<uint32_t>(profile.queueFamilies.size());
+				uint32_t extensionCount = static_cast<uint32_t>(profile.extensions.size());
+				file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+				file.write(reinterpret_cast<const char*>(&profile.features), sizeof(profile.features));
+				file.write(reinterpret_cast<const char*>(&queueFamilyCount), sizeof(queueFamilyCount));
+				file.write(reinterpret_cast<const char*>(&extensionCount), sizeof(extensionCount));
+				file.write(reinterpret_cast<const char*>(profile.queueFamilies.data()), queueFamilyCount * sizeof(VkQueueFamilyProperties));
+				file.write(reinterpret_cast<const char*>(profile.extensions.data()), extensionCount * sizeof(VkExtensionProperties));
+			}
+			if (!file.good()) {
+				std::cerr << "device cache: failed to write " << tempPath << std::endl;
+				return;
+			}
+		}
+		std::error_code error;
+		std::filesystem::rename(tempPath, options.deviceCachePath, error);
+		if (error) {
+			std::cerr << "device cache: failed to replace " << options.deviceCachePath << ": " << error.message() << std::endl;
+		}
+	}
+	
+	std::multimap<int32_t, const DeviceProfile*> rateDevices(const std::vector<DeviceProfile>& profiles) {
+		std::multimap<int32_t, const DeviceProfile*> scores{};
+		for (const auto& profile : profiles){
+			int32_t score = rateDevice(profile);
+			std::pair<int32_t, const DeviceProfile*> entry{score, &profile};
+			scores.insert(entry);
+		}
+		return scores;
+	}
+	
+	int32_t rateDevice(const DeviceProfile& profile) {
+		ScopedTimer timer{profiler, "rateDevice"};
+		//TODO(Gerald, 2025 04 12): add logic to explicitly prefer a physical device that supports drawing and presentation in the same queue
+		int32_t score = 0;
+		const VkPhysicalDeviceProperties& properties = profile.properties;
+		
+		if (!isDeviceSuitable(profile)) return false;
+		
+		switch(properties.deviceType) {
+			break;case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: {
+				score += 30;
+			} 
+			break;case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: {
+				score += 100;
+			}
+			break;case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: {
+				score += 5;
+			}
+			break;case VK_PHYSICAL_DEVICE_TYPE_CPU: {
+				score += 10; // software rasterizers like lavapipe, the only option on GPU-less batch nodes
+			}
+			break;default:{}
+		}
+		
+		score += properties.limits.maxImageDimension2D/128;
+		
+		if (verboseStartup()) std::cout << properties.deviceName << " : " << score << '\n';
+		
+		return score;
+	} 
+	
+	bool isDeviceSuitable(const DeviceProfile& profile) {
+		if (!profile.features.geometryShader) return false; // geometry shader is necessary
+		if (!profile.queueFamilyIndices.isComplete()) return false;
+		
+		if (!deviceSupportsRequiredExtensions(profile)) return false; // verifies swap chain support
+		
+		const SwapchainSupportDetails& swapchainSupport = profile.swapchainSupport;
+		bool swapchainIsAdequate = !swapchainSupport.formats.empty() && !swapchainSupport.presentModes.empty();
+		
+		return swapchainIsAdequate;
+	}
+	
+	bool deviceSupportsRequiredExtensions(const DeviceProfile& profile) {
+		for (const auto& extension : deviceExtensions) {
+			if (extension.required && !deviceSupportsExtension(extension.name, profile)) return false;
+		}
+		return true;
+	}
+	
+	// optional, the bindless table needs partially bound, update-after-bind arrays indexed non-uniformly
+	bool deviceSupportsBindless(const DeviceProfile& profile) {
+		if (!instanceHasProperties2 ||
+		    !deviceSupportsExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME, profile) ||
+		    !deviceSupportsExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, profile)) {
+			return false;
+		}
+		auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+		if (!getFeatures2) return false;
+		
+		VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &indexingFeatures;
+		getFeatures2(profile.device, &features);
+		return indexingFeatures.runtimeDescriptorArray
+			&& indexingFeatures.descriptorBindingPartiallyBound
+			&& indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+			&& indexingFeatures.shaderSampledImageArrayNonUniformIndexing
+			&& indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+			&& indexingFeatures.shaderStorageBufferArrayNonUniformIndexing
+			&& indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind;
+	}
+	
+	// optional, without it DeviceQueues tracks submissions with a fence each
+	bool deviceSupportsTimelines(const DeviceProfile& profile) {
+		if (!instanceHasProperties2 || !deviceSupportsExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, profile)) {
+			return false;
+		}
+		auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+		if (!getFeatures2) return false;
+		
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &timelineFeatures;
+		getFeatures2(profile.device, &features);
+		return timelineFeatures.timelineSemaphore;
+	}
+	
+	// optional, without it a retired swapchain waits for the present queue to go idle before it is destroyed
+	bool deviceSupportsPresentFences(const DeviceProfile& profile) {
+		if (!instanceHasSurfaceMaintenance1 || !deviceSupportsExtension(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME, profile)) {
+			return false;
+		}
+		auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+		if (!getFeatures2) return false;
+		
+		VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT maintenanceFeatures{};
+		maintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &maintenanceFeatures;
+		getFeatures2(profile.device, &features);
+		return maintenanceFeatures.swapchainMaintenance1;
+	}
+	
+	bool deviceSupportsExtension(const char* extension, const DeviceProfile& profile) {
+		bool supported = profile.extensionNames.count(extension) != 0;
+		if (supported && verboseStartup()) {
+			std::cout << "success: device supports: " << extension << '\n';
+		}
+		return supported;
+	}
+	
+	
+	static QueueFamilyIndices findQueueFamilies(const DeviceProfile& profile) {
+		QueueFamilyIndices indices;
+		
+		for (uint32_t i = 0 ; i < profile.queueFamilies.size() ; ++i) {
+			if (profile.queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+				indices.graphicsFamily = i;				
+			}
+			if (profile.queueFamilySupportsPresent[i]) {
+				indices.presentFamily = i;
+			}
+			
+			if (indices.isComplete()) {
+				break;
+			}
+		}
+		
+		// fewer capability bits usually means a separate engine that can run alongside graphics
+		auto findFamily = [&](VkQueueFlags wanted, VkQueueFlags unwanted) -> std::optional<uint32_t> {
+			for (uint32_t i = 0 ; i < profile.queueFamilies.size() ; ++i) {
+				VkQueueFlags flags = profile.queueFamilies[i].queueFlags;
+				if ((flags & wanted) == wanted && !(flags & unwanted)) return i;
+			}
+			return std::nullopt;
+		};
+		// graphics and compute queues support transfers implicitly, without necessarily reporting the bit
+		indices.transferFamily = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+		if (!indices.transferFamily) indices.transferFamily = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+		if (!indices.transferFamily) indices.transferFamily = indices.graphicsFamily;
+		indices.computeFamily = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+		if (!indices.computeFamily) indices.computeFamily = indices.graphicsFamily;
+		
+		return indices;
+	}
+	
+	void createLogicalDevice() {
+		const QueueFamilyIndices& indices = deviceProfile.queueFamilyIndices;
+		
+		/* every role gets its own queue as long as the family has one left, so e.g. transfers on a
+		   graphics+compute+transfer family still don't serialize behind rendering. present rides along
+		   on the graphics queue when they share a family */
+		std::map<uint32_t, uint32_t> queuesClaimed;
+		auto claimQueue = [&](uint32_t family) {
+			uint32_t available = deviceProfile.queueFamilies[family].queueCount;
+			uint32_t index = std::min(queuesClaimed[family]++, available - 1);
+			return DeviceQueues::Assignment{family, index};
+		};
+		std::array<DeviceQueues::Assignment, static_cast<size_t>(QueueRole::Count)> assignments{};
+		auto& graphics = assignments[static_cast<size_t>(QueueRole::Graphics)];
+		graphics = claimQueue(indices.graphicsFamily.value());
+		assignments[static_cast<size_t>(QueueRole::Present)] = indices.presentFamily == indices.graphicsFamily ? graphics : claimQueue(indices.presentFamily.value());
+		assignments[static_cast<size_t>(QueueRole::Transfer)] = claimQueue(indices.transferFamily.value());
+		assignments[static_cast<size_t>(QueueRole::Compute)] = claimQueue(indices.computeFamily.value());
+		
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
+		queueCreateInfos.reserve(queuesClaimed.size());
+		
+		std::vector<float> queuePriorities(16, 1.0f);
+		for(const auto& [family, claimed] : queuesClaimed) {
+			VkDeviceQueueCreateInfo queueCreateInfo{};
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = family;			
+			queueCreateInfo.queueCount = std::min(claimed, deviceProfile.queueFamilies[family].queueCount);
+			queueCreateInfo.pQueuePriorities = queuePriorities.data();
+			
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+		
+		// for GPU culling: many indirect draws per call, and firstInstance tells the vertex shader its instance
+		VkPhysicalDeviceFeatures deviceFeatures{};
+		deviceFeatures.multiDrawIndirect = deviceProfile.features.multiDrawIndirect;
+		deviceFeatures.drawIndirectFirstInstance = deviceProfile.features.drawIndirectFirstInstance;
+		
+		std::vector<const char*> enabledExtensions;
+		for (const auto& extension : deviceExtensions) {
+			if (extension.required || ((instanceHasProperties2 || !extension.needsProperties2) && deviceSupportsExtension(extension.name, deviceProfile))) {
+				enabledExtensions.push_back(extension.name);
+			}
+		}
+		void *featureChain = nullptr; // the optional feature structs that are enabled, for createInfo.pNext
+		VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		bindlessEnabled = options.bindless && deviceSupportsBindless(deviceProfile);
+		if (bindlessEnabled) {
+			enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+			indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+			indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+			indexingFeatures.pNext = featureChain;
+			featureChain = &indexingFeatures;
+		}
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		timelinesEnabled = options.timelines && deviceSupportsTimelines(deviceProfile);
+		if (timelinesEnabled) {
+			enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			timelineFeatures.timelineSemaphore = VK_TRUE;
+			timelineFeatures.pNext = featureChain;
+			featureChain = &timelineFeatures;
+		}
+		VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT maintenanceFeatures{};
+		maintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+		presentFencesEnabled = deviceSupportsPresentFences(deviceProfile);
+		if (presentFencesEnabled) {
+			enabledExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+			maintenanceFeatures.swapchainMaintenance1 = VK_TRUE;
+			maintenanceFeatures.pNext = featureChain;
+			featureChain = &maintenanceFeatures;
+		}
+		
+		VkDeviceCreateInfo createInfo {
+			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+			.pNext = featureChain,
+			.flags = NOT_UNDERSTOOD,
+			.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
+			.pQueueCreateInfos = queueCreateInfos.data(),
+			.enabledLayerCount = enableValidationLayers ? static_cast<uint32_t>(validationLayers.size()) : 0,
+			.ppEnabledLayerNames = enableValidationLayers ? validationLayers.data() : 0,
+			
+			.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()),
+			.ppEnabledExtensionNames = enabledExtensions.data(),
+			.pEnabledFeatures = &deviceFeatures,
+		};
+		
+		VkResult result;
+		{
+			ScopedTimer timer{profiler, "vkCreateDevice"};
+			result = vkCreateDevice(physicalDevice, &createInfo, allocator, &device);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create logical device");
+		}
+		enabledDeviceExtensions.assign(enabledExtensions.begin(), enabledExtensions.end());
+		
+		queues.init(device, allocator, assignments, timelinesEnabled);
+		queues.print(startupLog());
+		
+		memoryAllocator.init(physicalDevice, device, allocator);
+		// one batch per frame in flight plus the one being filled
+		uploadRing.init(device, allocator, memoryAllocator, queues, VkDeviceSize{options.uploadRingMiB} << 20, targetFramesInFlight() + 1);
+		{ ScopedTimer timer{profiler, "createPipelineCache"}; createPipelineCache(); }
+	}
+	
+	void createPipelineCache() {
+		std::vector<char> initialData = loadPipelineCacheData();
+		
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = initialData.size();
+		createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+		
+		VkResult result = vkCreatePipelineCache(device, &createInfo, allocator, &pipelineCache);
+		if (result != VK_SUCCESS && !initialData.empty()) {
+			startupLog() << "pipeline cache: driver rejected cached data, starting cold\n";
+			createInfo.initialDataSize = 0;
+			createInfo.pInitialData = nullptr;
+			result = vkCreatePipelineCache(device, &createInfo, allocator, &pipelineCache);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline cache");
+		}
+		pipelineCacheStats.loadedBytes = createInfo.initialDataSize;
 	}
-
-    void initVulkan() {
-		createInstance();
-		setupDebugMessenger();
-		createSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-		createSwapchain();
-    }
 	
-	void createInstance() {
-		VkResult result;
+	// returns the driver blob of the cache file, or nothing if there is none or it belongs to another device/driver
+	std::vector<char> loadPipelineCacheData() {
+		if (options.pipelineCachePath.empty()) return {};
 		
-		VkApplicationInfo appInfo{};
-		appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-		appInfo.pApplicationName = "Hello Triangle";
-		appInfo.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
-		appInfo.pEngineName = "No Engine";
-		appInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		std::ifstream file(options.pipelineCachePath, std::ios::binary);
+		if (!file.is_open()) {
+			startupLog() << "pipeline cache: no cache file, starting cold\n";
+			return {};
+		}
 		
-		VkInstanceCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-		createInfo.pApplicationInfo = &appInfo;		
+		PipelineCacheFileHeader header{};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		bool valid = file.good()
+			&& header.magic == PIPELINE_CACHE_MAGIC
+			&& header.headerVersion == PIPELINE_CACHE_HEADER_VERSION
+			&& header.vendorID == deviceProfile.properties.vendorID
+			&& header.deviceID == deviceProfile.properties.deviceID
+			&& header.driverVersion == deviceProfile.properties.driverVersion
+			&& 0 == std::memcmp(header.pipelineCacheUUID, deviceProfile.properties.pipelineCacheUUID, VK_UUID_SIZE);
+		if (!valid) {
+			startupLog() << "pipeline cache: stale or foreign cache file discarded\n";
+			return {};
+		}
 		
-		std::vector<VkExtensionProperties> availableExtensions = getAvailableExtensions();
-		std::cout << "available extensions:\n";
-		for(const auto& extension : availableExtensions) {
-			std::cout << '\t' << extension.extensionName << " : " << extension.specVersion << '\n';
-		}		
+		// checked before allocating, a corrupt size field must not turn into a huge allocation
+		file.seekg(0, std::ios::end);
+		uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+		file.seekg(sizeof(header));
+		if (!file.good() || header.dataSize != fileSize - sizeof(header)) {
+			startupLog() << "pipeline cache: truncated cache file discarded\n";
+			return {};
+		}
 		
-		std::vector<const char*> requiredExtensions = getRequiredExtensions();		
-		createInfo.enabledExtensionCount += requiredExtensions.size();
-		createInfo.ppEnabledExtensionNames = requiredExtensions.data();				
+		std::vector<char> data(header.dataSize);
+		file.read(data.data(), data.size());
+		if (static_cast<uint64_t>(file.gcount()) != header.dataSize) {
+			startupLog() << "pipeline cache: truncated cache file discarded\n";
+			return {};
+		}
+		return data;
+	}
+	
+	// writes to a temporary file first so a crash mid-write never leaves a corrupt cache behind
+	void savePipelineCache() {
+		if (options.pipelineCachePath.empty() || pipelineCache == VK_NULL_HANDLE) return;
 		
-		bool extensions_supported = checkRequiredExtensions(createInfo, availableExtensions);
-		if (!extensions_supported) {
-			throw std::runtime_error("unsupported extension required.");
+		size_t dataSize = 0;
+		VkResult result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+		std::vector<char> data(dataSize);
+		if (result == VK_SUCCESS) {
+			result = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data());
+		}
+		if (result != VK_SUCCESS) {
+			std::cerr << "pipeline cache: failed to retrieve cache data, not saved" << std::endl;
+			return;
 		}
 		
+		PipelineCacheFileHeader header;
+		std::memset(&header, 0, sizeof(header)); // the padding before dataSize goes to disk too
+		header.magic = PIPELINE_CACHE_MAGIC;
+		header.headerVersion = PIPELINE_CACHE_HEADER_VERSION;
+		header.vendorID = deviceProfile.properties.vendorID;
+		header.deviceID = deviceProfile.properties.deviceID;
+		header.driverVersion = deviceProfile.properties.driverVersion;
+		std::memcpy(header.pipelineCacheUUID, deviceProfile.properties.pipelineCacheUUID, VK_UUID_SIZE);
+		header.dataSize = dataSize;
 		
-		VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo{};
-		if (enableValidationLayers) {
-			bool layers_supported = checkValidationLayerSupport();
-			if (!layers_supported) {
-				throw std::runtime_error("unsupported validation layer requested.");
+		std::string tempPath = options.pipelineCachePath + ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(data.data(), dataSize);
+			if (!file.good()) {
+				std::cerr << "pipeline cache: failed to write " << tempPath << std::endl;
+				return;
 			}
-			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-			createInfo.ppEnabledLayerNames = validationLayers.data();
-			
-			populateDebugUtilsMessengerCreateInfoEXT(messengerCreateInfo);
-			createInfo.pNext = &messengerCreateInfo;
 		}
+		std::error_code error;
+		std::filesystem::rename(tempPath, options.pipelineCachePath, error);
+		if (error) {
+			std::cerr << "pipeline cache: failed to replace " << options.pipelineCachePath << ": " << error.message() << std::endl;
+			return;
+		}
+		std::cout << "pipeline cache: saved " << dataSize << " bytes\n";
+	}
+	
+	/* creates one pipeline and asks the driver whether the cache served it. called from the pipeline
+	   manager's threads too, so it must not touch anything but its arguments and the device */
+	VkResult createGraphicsPipelineWithFeedback(VkPipelineCache cache, const VkGraphicsPipelineCreateInfo& createInfo,
+	                                            VkPipeline *pipeline, CacheLookup& lookup) {
+		VkGraphicsPipelineCreateInfo info = createInfo;
+		VkPipelineCreationFeedbackEXT pipelineFeedback{};
+		std::vector<VkPipelineCreationFeedbackEXT> stageFeedbacks(info.stageCount); // must be given, even if unused
+		VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+		if (deviceExtensionEnabled(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+			feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+			feedbackInfo.pNext = info.pNext;
+			feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+			feedbackInfo.pipelineStageCreationFeedbackCount = info.stageCount;
+			feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+			info.pNext = &feedbackInfo;
+		}
+		
+		VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &info, allocator, pipeline);
+		lookup = CacheLookup::Unknown; // the driver may leave the feedback invalid even with the extension
+		if (result == VK_SUCCESS && (pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+			bool hit = pipelineFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+			lookup = hit ? CacheLookup::Hit : CacheLookup::Miss;
+		}
+		return result;
+	}
+	
+	VkPipeline createGraphicsPipelineCached(const VkGraphicsPipelineCreateInfo& createInfo) {
+		auto start = std::chrono::steady_clock::now();
 		
-		result = vkCreateInstance(&createInfo, nullptr, &instance);		
+		VkPipeline pipeline;
+		VkResult result;
+		CacheLookup lookup;
+		{
+			ScopedTimer timer{profiler, "vkCreateGraphicsPipelines"};
+			result = createGraphicsPipelineWithFeedback(pipelineCache, createInfo, &pipeline, lookup);
+		}
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("vkCreateInstance() failed.");
+			throw std::runtime_error("failed to create graphics pipeline");
+		}
+		
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		switch (lookup) {
+			case CacheLookup::Hit:
+				++pipelineCacheStats.hits;
+				pipelineCacheStats.hitMilliseconds += milliseconds;
+				break;
+			case CacheLookup::Miss:
+				++pipelineCacheStats.misses;
+				pipelineCacheStats.missMilliseconds += milliseconds;
+				break;
+			case CacheLookup::Unknown:
+				++pipelineCacheStats.unknown;
+				pipelineCacheStats.unknownMilliseconds += milliseconds;
+				break;
 		}
+		return pipeline;
 	}
 	
-	std::vector<VkExtensionProperties> getAvailableExtensions() {
-		uint32_t extensionCount = 0;
-		VkResult result = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
-		std::vector<VkExtensionProperties> extensions(extensionCount);
-		result = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
-		return extensions;
+	void printPipelineCacheStats() {
+		const auto& stats = pipelineCacheStats;
+		std::cout << "pipeline cache: loaded " << stats.loadedBytes << " bytes";
+		if (stats.hits + stats.misses != 0) {
+			std::cout << ", " << stats.hits << " hits (" << stats.hitMilliseconds << " ms), "
+				<< stats.misses << " misses (" << stats.missMilliseconds << " ms)";
+		}
+		if (stats.unknown != 0) {
+			std::cout << ", " << stats.unknown << " compiles (" << stats.unknownMilliseconds << " ms) the driver gave no cache feedback for";
+		}
+		std::cout << '\n';
 	}
 	
-	std::vector<const char*> getRequiredExtensions() {		
-		uint32_t extensionCount;
-		const char** requiredExtensionNames = glfwGetRequiredInstanceExtensions(&extensionCount);
-		std::vector<const char*> requiredExtensions(requiredExtensionNames, requiredExtensionNames + extensionCount);
+	// oldSwapchain lets the driver hand resources over, it is retired (not destroyed) by the caller
+	void createSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE) {
+		const SwapchainSupportDetails& swapchainSupport = deviceProfile.swapchainSupport;
 		
-		if (enableValidationLayers) {
-			requiredExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
+		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
+		VkExtent2D extent = chooseSwapExtent(swapchainSupport.capabilities);
+		
+		
+		/* sticking to minimum means that we may sometimes have to wait on the driver to 
+		   complete internal operations before we can acquire another image to render to */
+		uint32_t imageCount = swapchainSupport.capabilities.minImageCount + presentPolicySettings(options.presentPolicy).extraImages;
+		if (swapchainSupport.capabilities.maxImageCount != 0 && 
+		    imageCount > swapchainSupport.capabilities.maxImageCount) {
+			imageCount = swapchainSupport.capabilities.maxImageCount;
 		}
 		
-		return requiredExtensions;
+		VkSwapchainCreateInfoKHR createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+		createInfo.surface = surface;
+		createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = surfaceFormat.format;
+        createInfo.imageColorSpace = surfaceFormat.colorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1; //"This is always 1 unless you are developing a stereoscopic 3D application"
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // render directly to images (no post processing)
+		if (!options.capturePath.empty()) {
+			if (!(swapchainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+				throw std::runtime_error("capture: swapchain images can't be copied from on this surface");
+			}
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+		if (options.blur) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, surfaceFormat.format, &formatProperties);
+			VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+			if (!(swapchainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) ||
+			    (formatProperties.optimalTilingFeatures & needed) != needed) {
+				throw std::runtime_error("blur: swapchain images can't be blitted to on this surface");
+			}
+			createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		
+		const QueueFamilyIndices& indices = deviceProfile.queueFamilyIndices;
+		uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+		if (indices.graphicsFamily == indices.presentFamily) {
+			createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		} else {
+			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT; // avoid managing image ownership among queue families
+			createInfo.queueFamilyIndexCount = 2;
+			createInfo.pQueueFamilyIndices = queueFamilyIndices;
+		}
+        createInfo.preTransform = swapchainSupport.capabilities.currentTransform; // no special transform
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; //ignore alpha
+        createInfo.presentMode = presentMode;
+        createInfo.clipped = VK_TRUE;
+        createInfo.oldSwapchain = oldSwapchain;
+		
+		VkResult result;
+		{
+			ScopedTimer timer{profiler, "vkCreateSwapchainKHR"};
+			result = vkCreateSwapchainKHR(device, &createInfo, allocator, &swapchain);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed creating swap chain");
+		}
+				
+		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+		swapchainImages.resize(imageCount);
+		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+		
+		swapchainImageExtent = extent;
+		swapchainImageFormat = surfaceFormat.format;
+		swapchainPresentMode = presentMode;
 	}
 	
-	bool checkRequiredExtensions(const VkInstanceCreateInfo& createInfo, const std::vector<VkExtensionProperties>& extensions) {
-		const char*required;
-		bool all_supported = true;
-		std::cout << "required extensions:\n";
-		for (uint32_t i = 0 ; i < createInfo.enabledExtensionCount ; ++i) {
-			required = createInfo.ppEnabledExtensionNames[i];
-			bool supported = false;
-			for (const auto& available : extensions) {
-				supported = !std::strcmp(required, available.extensionName);
-				if (supported) break;
-			}			
-			std::cout << '\t' << required << " : " << (supported ? "was found" : "not found") << '\n';
-			all_supported &= supported;			
+	void createImageViews() {
+		swapchainImageViews.resize(swapchainImages.size());
+		for (size_t i = 0 ; i < swapchainImages.size() ; ++i) {
+			VkImageViewCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			createInfo.image = swapchainImages[i];
+			createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			createInfo.format = swapchainImageFormat;
+			createInfo.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+			createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			createInfo.subresourceRange.baseMipLevel = 0;
+			createInfo.subresourceRange.levelCount = 1;
+			createInfo.subresourceRange.baseArrayLayer = 0;
+			createInfo.subresourceRange.layerCount = 1;
+			
+			VkResult result = vkCreateImageView(device, &createInfo, allocator, &swapchainImageViews[i]);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create image view");
+			}
 		}
-		
-		return all_supported;
 	}
 	
-	bool checkValidationLayerSupport() {		
-		uint32_t layerCount;
-		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
-		std::vector<VkLayerProperties> availableLayers(layerCount);
-		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
-		
-		std::cout << "available validation layers:\n";		
-		for (const auto& available : availableLayers) {
-			std::cout << '\t' << available.layerName << '\n';
+	void createRenderFinishedSemaphores() {
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		renderFinishedSemaphores.assign(swapchainImages.size(), VK_NULL_HANDLE);
+		for (auto& semaphore : renderFinishedSemaphores) {
+			if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &semaphore) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create render finished semaphore");
+			}
 		}
+	}
+	
+	void createRenderPass() {
+		VkAttachmentDescription colorAttachment{};
+		colorAttachment.format = swapchainImageFormat;
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // cleared anyway
+		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // the render graph takes it from here
 		
-		bool all_supported = true;
-		std::cout << "checking validation layers:\n";
-		for (const auto& requested : validationLayers) {
-			std::cout << '\t' << requested << '\n';
-			bool supported = false;
-			for (const auto& available : availableLayers) {
-				supported = 0 == std::strcmp(requested, available.layerName);
-				if (supported) break;
-			}			
-			all_supported &= supported;
+		VkAttachmentReference colorAttachmentRef{};
+		colorAttachmentRef.attachment = 0;
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef;
+		
+		// the layout transition must wait until the presentation engine is done reading the image
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.srcAccessMask = 0;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		
+		VkRenderPassCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		createInfo.attachmentCount = 1;
+		createInfo.pAttachments = &colorAttachment;
+		createInfo.subpassCount = 1;
+		createInfo.pSubpasses = &subpass;
+		createInfo.dependencyCount = 1;
+		createInfo.pDependencies = &dependency;
+		
+		VkResult result = vkCreateRenderPass(device, &createInfo, allocator, &renderPass);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to create render pass");
+		}
+	}
+	
+	void createFramebuffers() {
+		swapchainFramebuffers.resize(swapchainImageViews.size());
+		for (size_t i = 0 ; i < swapchainImageViews.size() ; ++i) {
+			VkFramebufferCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			createInfo.renderPass = renderPass;
+			createInfo.attachmentCount = 1;
+			createInfo.pAttachments = &swapchainImageViews[i];
+			createInfo.width = swapchainImageExtent.width;
+			createInfo.height = swapchainImageExtent.height;
+			createInfo.layers = 1;
 			
-			if (!all_supported) break;
+			VkResult result = vkCreateFramebuffer(device, &createInfo, allocator, &swapchainFramebuffers[i]);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("failed to create framebuffer");
+			}
 		}
-		return all_supported;
 	}
 	
-	void setupDebugMessenger() {
-		if (!enableValidationLayers) return;
+	VkShaderModule createShaderModule(const std::vector<char>& code) {
+		VkShaderModuleCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = code.size();
+		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data()); // std::vector's allocator satisfies uint32_t alignment
 		
-		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
-		populateDebugUtilsMessengerCreateInfoEXT(createInfo);
-		VkResult result = createDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger);
+		VkShaderModule shaderModule;
+		VkResult result = vkCreateShaderModule(device, &createInfo, allocator, &shaderModule);
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("failed to setup debug messenger.");
+			throw std::runtime_error("failed to create shader module");
 		}
+		return shaderModule;
 	}
 	
-	void populateDebugUtilsMessengerCreateInfoEXT(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
-		createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-		createInfo.messageSeverity = /*VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | */VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-		createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-		createInfo.pfnUserCallback = debugCallback;
-		createInfo.pUserData = this;
+	// the unspecialized pipeline, drawn with until the variant asked for has been compiled
+	static PipelineVariant fallbackVariant() {
+		PipelineVariant variant;
+		variant.name = "fallback";
+		variant.vertexShader = "shaders/vert.spv";
+		variant.fragmentShader = "shaders/frag.spv";
+		return variant;
 	}
 	
-	void createSurface() {
-		VkResult result = glfwCreateWindowSurface(instance, window, nullptr, &surface);
+	void createGraphicsPipeline() {
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		VkDescriptorSetLayout instanceSetLayout = instanceCuller.getSetLayout();
+		VkPushConstantRange instancePushConstants = InstanceCuller::drawConstantRange();
+		if (instanceCuller.active()) {
+			// the other pipelines don't use them, but sharing one layout keeps every variant buildable against it
+			pipelineLayoutInfo.setLayoutCount = 1;
+			pipelineLayoutInfo.pSetLayouts = &instanceSetLayout;
+			pipelineLayoutInfo.pushConstantRangeCount = 1;
+			pipelineLayoutInfo.pPushConstantRanges = &instancePushConstants;
+		}
+		VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocator, &pipelineLayout);
 		if (result != VK_SUCCESS) {
-			throw std::runtime_error("failed to create window surface");
+			throw std::runtime_error("failed to create pipeline layout");
 		}
 		
-		return;
+		graphicsPipeline = buildPipeline(fallbackVariant(), renderPass, pipelineLayout, [this](const VkGraphicsPipelineCreateInfo& info) {
+			return createGraphicsPipelineCached(info);
+		});
+		pipelineManager.setFallback(graphicsPipeline);
 	}
 	
-	void pickPhysicalDevice() {
-		uint32_t deviceCount;
-		VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-		std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
-		result = vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+	/* fills in the state every pipeline of ours shares and hands the create info to create. the pipeline
+	   manager's threads call this too, so it must not touch anything but its arguments and the device */
+	VkPipeline buildPipeline(const PipelineVariant& variant, VkRenderPass renderPass, VkPipelineLayout layout,
+	                         const std::function<VkPipeline(const VkGraphicsPipelineCreateInfo&)>& create) {
+		VkShaderModule vertShaderModule = createShaderModule(files.read(variant.vertexShader));
+		VkShaderModule fragShaderModule;
+		try {
+			fragShaderModule = createShaderModule(files.read(variant.fragmentShader));
+		} catch (...) {
+			vkDestroyShaderModule(device, vertShaderModule, allocator);
+			throw;
+		}
 		
-		std::cout << "Physical Devices found:\n";
-		for (const auto& device : physicalDevices) {
-			VkPhysicalDeviceProperties properties{};
-			vkGetPhysicalDeviceProperties(device, &properties);
-			std::cout << '\t' << properties.deviceName << '\n';			
+		// every constant is 32 bits, ids a stage doesn't declare are ignored by it
+		std::vector<VkSpecializationMapEntry> mapEntries;
+		std::vector<uint32_t> specializationData;
+		for (const auto& [id, value] : variant.specialization) {
+			mapEntries.push_back({id, static_cast<uint32_t>(specializationData.size() * sizeof(uint32_t)), sizeof(uint32_t)});
+			specializationData.push_back(value);
 		}
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+		specializationInfo.pMapEntries = mapEntries.data();
+		specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+		specializationInfo.pData = specializationData.data();
 		
-		VkPhysicalDevice picked{};
-		std::multimap<int32_t, VkPhysicalDevice> scores = rateDevices(physicalDevices);
-		if (scores.rbegin()->first > 0) {
-			picked = scores.rbegin()->second;
-		} else {
-			throw std::runtime_error("no suitable GPU found.");
+		VkPipelineShaderStageCreateInfo shaderStages[2]{};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = vertShaderModule;
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = fragShaderModule;
+		shaderStages[1].pName = "main";
+		for (auto& stage : shaderStages) {
+			stage.pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
 		}
 		
-		physicalDevice = picked;
+		VkVertexInputBindingDescription binding{0, sizeof(MeshVertex), VK_VERTEX_INPUT_RATE_VERTEX};
+		VkVertexInputAttributeDescription attributes[2] = {
+			{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, position)},
+			{1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, normal)},
+		};
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO; // otherwise vertices are hardcoded in the shader
+		if (variant.meshVertices) {
+			vertexInputInfo.vertexBindingDescriptionCount = 1;
+			vertexInputInfo.pVertexBindingDescriptions = &binding;
+			vertexInputInfo.vertexAttributeDescriptionCount = 2;
+			vertexInputInfo.pVertexAttributeDescriptions = attributes;
+		}
 		
-		return;
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = variant.topology;
+		inputAssembly.primitiveRestartEnable = VK_FALSE;
+		
+		// viewport and scissor are set at record time so the pipeline survives swapchain changes
+		std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+		dynamicState.pDynamicStates = dynamicStates.data();
+		
+		VkPipelineViewportStateCreateInfo viewportState{};
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+		
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = VK_FALSE;
+		rasterizer.rasterizerDiscardEnable = VK_FALSE;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = variant.cullMode;
+		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+		rasterizer.depthBiasEnable = VK_FALSE;
+		
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.sampleShadingEnable = VK_FALSE;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.blendEnable = VK_FALSE;
+		
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.logicOpEnable = VK_FALSE;
+		colorBlending.attachmentCount = 1;
+		colorBlending.pAttachments = &colorBlendAttachment;
+		
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &dynamicState;
+		pipelineInfo.layout = layout;
+		pipelineInfo.renderPass = renderPass;
+		pipelineInfo.subpass = 0;
+		
+		VkPipeline pipeline;
+		try {
+			pipeline = create(pipelineInfo);
+		} catch (...) {
+			vkDestroyShaderModule(device, fragShaderModule, allocator);
+			vkDestroyShaderModule(device, vertShaderModule, allocator);
+			throw;
+		}
+		
+		vkDestroyShaderModule(device, fragShaderModule, allocator);
+		vkDestroyShaderModule(device, vertShaderModule, allocator);
+		return pipeline;
 	}
 	
-	std::multimap<int32_t, VkPhysicalDevice> rateDevices(std::vector<VkPhysicalDevice> devices) {
-		std::multimap<int32_t, VkPhysicalDevice> scores{};
-		for (const auto& device : devices){
-			int32_t score = rateDevice(device);
-			std::pair<int32_t, VkPhysicalDevice> entry{score, device};
-			scores.insert(entry);
+	// every COLOR_MODE of the fragment shader, compiled in the background while the first frames use the fallback
+	void createPipelineVariants() {
+		uint32_t threadCount = options.pipelineThreads != 0 ? options.pipelineThreads : std::max(1u, std::thread::hardware_concurrency());
+		pipelineManager.init(device, allocator, pipelineCache,
+			[this](const PipelineVariant& variant, VkRenderPass renderPass, VkPipelineLayout layout, VkPipelineCache cache, CacheLookup& lookup) {
+				return buildPipeline(variant, renderPass, layout, [&](const VkGraphicsPipelineCreateInfo& info) {
+					VkPipeline pipeline;
+					if (createGraphicsPipelineWithFeedback(cache, info, &pipeline, lookup) != VK_SUCCESS) {
+						throw std::runtime_error("vkCreateGraphicsPipelines failed");
+					}
+					return pipeline;
+				});
+			}, threadCount);
+		pipelineManager.setFallback(graphicsPipeline);
+		
+		const char *colorModeNames[] = {"vertex-color", "grayscale", "inverted"};
+		for (uint32_t mode = 0 ; mode < 3 ; ++mode) {
+			PipelineVariant variant = fallbackVariant();
+			variant.name = colorModeNames[mode];
+			variant.specialization = {{0, mode}}; // COLOR_MODE
+			colorModeVariants[mode] = pipelineManager.declare(variant);
 		}
-		return scores;
+		if (!options.meshPath.empty()) {
+			PipelineVariant variant = fallbackVariant();
+			variant.name = std::string("mesh ") + colorModeNames[options.colorMode];
+			variant.vertexShader = "shaders/mesh_vert.spv";
+			variant.specialization = {{0, options.colorMode}};
+			variant.cullMode = VK_CULL_MODE_NONE; // no telling which winding the source used
+			variant.meshVertices = true;
+			meshVariant = pipelineManager.declare(variant);
+		}
+		if (instanceCuller.active()) {
+			PipelineVariant variant = fallbackVariant();
+			variant.name = std::string("instanced ") + colorModeNames[options.colorMode];
+			variant.vertexShader = "shaders/instanced_vert.spv";
+			variant.specialization = {{0, options.colorMode}};
+			variant.cullMode = VK_CULL_MODE_NONE;
+			variant.meshVertices = true;
+			instancedVariant = pipelineManager.declare(variant);
+		}
+		pipelineManager.build(renderPass, pipelineLayout);
 	}
 	
-	int32_t rateDevice(const VkPhysicalDevice& device) {
-		//TODO(Gerald, 2025 04 12): add logic to explicitly prefer a physical device that supports drawing and presentation in the same queue
-		int32_t score = 0;
-		VkPhysicalDeviceProperties properties;
-		vkGetPhysicalDeviceProperties(device, &properties);
-		VkPhysicalDeviceFeatures features;
-		vkGetPhysicalDeviceFeatures(device, &features);
+	/* copies the sections straight from the file mapping into the upload ring, the mesh never passes through
+	   the heap. in pieces, so meshes larger than the ring stream through it */
+	void loadMesh() {
+		if (options.meshPath.empty()) {
+			if (instanceCuller.active()) loadTriangleMesh();
+			return;
+		}
 		
-		if (!isDeviceSuitable(device, features)) return false;
+		MeshFile mesh(options.meshPath);
+		const MeshFileHeader& header = mesh.getHeader();
+		meshVertexBuffer = memoryAllocator.createBuffer(mesh.vertexBytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, DeviceMemoryAllocator::Lifetime::Persistent, options.defragment);
+		meshIndexBuffer = memoryAllocator.createBuffer(mesh.indexBytes(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, DeviceMemoryAllocator::Lifetime::Persistent, options.defragment);
+		meshIndexCount = header.indexCount;
+		meshIndexType = header.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
 		
-		switch(properties.deviceType) {
-			break;case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: {
-				score += 30;
-			} 
-			break;case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: {
-				score += 100;
-			}
-			break;case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: {
-				score += 5;
+		VkDeviceSize chunkSize = std::max<VkDeviceSize>(options.uploadRingMiB * 1048576ull / 4, 4);
+		auto upload = [&](VkBuffer dst, const char *data, VkDeviceSize size, VkAccessFlags access) {
+			for (VkDeviceSize offset = 0 ; offset < size ; offset += chunkSize) {
+				uploadRing.uploadBuffer(dst, offset, data + offset, std::min(chunkSize, size - offset), access, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
 			}
-			break;case VK_PHYSICAL_DEVICE_TYPE_CPU: {
-				score += 10;
-			}
-			break;default:{}
+		};
+		upload(meshVertexBuffer->buffer, mesh.vertexData(), mesh.vertexBytes(), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+		upload(meshIndexBuffer->buffer, mesh.indexData(), mesh.indexBytes(), VK_ACCESS_INDEX_READ_BIT);
+		startupLog() << "mesh: " << header.vertexCount << " vertices, " << header.indexCount / 3 << " triangles from " << options.meshPath << '\n';
+	}
+	
+	// the instances need vertex and index buffers, without --mesh they get the triangle as one
+	void loadTriangleMesh() {
+		const MeshVertex vertices[3] = {
+			{{0.0f, 0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}}, // normals picked for the vertex colors of shader.vert
+			{{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}},
+			{{-0.5f, -0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+		};
+		const uint16_t indices[3] = {0, 1, 2};
+		meshVertexBuffer = memoryAllocator.createBuffer(sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, DeviceMemoryAllocator::Lifetime::Persistent, options.defragment);
+		meshIndexBuffer = memoryAllocator.createBuffer(sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, DeviceMemoryAllocator::Lifetime::Persistent, options.defragment);
+		meshIndexCount = 3;
+		meshIndexType = VK_INDEX_TYPE_UINT16;
+		uploadRing.uploadBuffer(meshVertexBuffer->buffer, 0, vertices, sizeof(vertices), VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		uploadRing.uploadBuffer(meshIndexBuffer->buffer, 0, indices, sizeof(indices), VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+	
+	/* builds a new swapchain on top of the current one without waiting for the device. the old one keeps
+	   presenting what was already queued and is destroyed by destroyRetiredSwapchains() once the frames that
+	   used it and their presents are done. returns false while the window is minimized, there is nothing to create then */
+	bool recreateSwapchain() {
+		if (!options.headless) {
+			int width = 0, height = 0;
+			glfwGetFramebufferSize(window, &width, &height);
+			if (width == 0 || height == 0) return false;
 		}
 		
-		score += properties.limits.maxImageDimension2D/128;
+		ScopedTimer timer{profiler, "recreateSwapchain"};
+		deviceProfile.swapchainSupport = querySwapchainSupport(physicalDevice); // extent and even formats change with the display
 		
-		std::cout << properties.deviceName << " : " << score << '\n';
+		RetiredSwapchain retired{};
+		retired.swapchain = swapchain;
+		retired.imageViews = std::move(swapchainImageViews);
+		retired.framebuffers = std::move(swapchainFramebuffers);
+		retired.renderFinishedSemaphores = std::move(renderFinishedSemaphores);
+		retired.retiredAtFrame = frameCounter;
+		VkFormat oldFormat = swapchainImageFormat;
 		
-		return score;
-	} 
+		try {
+			createSwapchain(retired.swapchain);
+		} catch (...) {
+			swapchainImageViews = std::move(retired.imageViews);
+			swapchainFramebuffers = std::move(retired.framebuffers);
+			renderFinishedSemaphores = std::move(retired.renderFinishedSemaphores);
+			throw;
+		}
+		createImageViews();
+		createRenderFinishedSemaphores();
+		if (swapchainImageFormat != oldFormat) {
+			retired.renderPass = renderPass;
+			retired.pipelineLayout = pipelineLayout;
+			retired.pipeline = graphicsPipeline;
+			createRenderPass();
+			createGraphicsPipeline();
+			retired.variantPipelines = pipelineManager.invalidate(renderPass, pipelineLayout); // waits for compiles in flight
+		}
+		createFramebuffers();
+		retiredSwapchains.push_back(std::move(retired));
+		
+		// the image count may differ, and no value recorded for the old swapchain's images means anything for the new ones
+		imagesInFlight.assign(swapchainImages.size(), 0);
+		swapchainOutOfDate = false;
+		framePacing.breakSequence();
+		++swapchainRecreations;
+		return true;
+	}
+	
+	// CPU scopes of the frame loop only go into the profiler while there's a GPU trace to merge them with
+	bool frameTraceActive() const {
+		return !options.gpuTracePath.empty() && frameCounter < options.gpuTraceFrames;
+	}
+	
+	void printRecordingStats() {
+		if (frameCounter == 0) return;
+		std::cout << "command recording: " << std::fixed << std::setprecision(3) << recordMilliseconds / frameCounter << " ms/frame for "
+		          << options.drawCount << " draws on " << std::max(options.recordThreads, 1u) << " thread(s)";
+		if (options.recordThreads > 1) {
+			JobSystem::Stats stats = jobSystem.getStats();
+			std::cout << ", " << stats.jobs << " jobs, " << stats.steals << " stolen";
+		}
+		std::cout << '\n';
+	}
+	
+	/* a retired swapchain goes once the frames rendered to it have finished and so have its presents, which the
+	   graphics queue knows nothing about. with present fences they are tracked one by one, otherwise the present
+	   queue has to go idle first. all: the device is idle, wait for the presents of every swapchain */
+	void destroyRetiredSwapchains(bool all) {
+		if (presentFencesEnabled) pollPresentFences(all);
+		if (retiredSwapchains.empty()) return;
+		auto presentsPending = [&](VkSwapchainKHR swapchain) {
+			return std::any_of(presentFences.begin(), presentFences.end(), [&](const PresentFence& present) { return present.swapchain == swapchain; });
+		};
+		auto done = [&](const RetiredSwapchain& retired) {
+			return (all || retired.retiredAtFrame <= framesCompleted) && !presentsPending(retired.swapchain);
+		};
+		bool presentQueueIdle = false;
+		for (auto& retired : retiredSwapchains) {
+			if (!done(retired)) continue;
+			if (!presentFencesEnabled && !presentQueueIdle) {
+				queues.waitIdle(QueueRole::Present);
+				presentQueueIdle = true;
+			}
+			for (auto framebuffer : retired.framebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, allocator);
+			}
+			for (auto imageView : retired.imageViews) {
+				vkDestroyImageView(device, imageView, allocator);
+			}
+			for (auto semaphore : retired.renderFinishedSemaphores) {
+				vkDestroySemaphore(device, semaphore, allocator);
+			}
+			for (auto pipeline : retired.variantPipelines) {
+				vkDestroyPipeline(device, pipeline, allocator);
+			}
+			if (retired.pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, retired.pipeline, allocator);
+				vkDestroyPipelineLayout(device, retired.pipelineLayout, allocator);
+				vkDestroyRenderPass(device, retired.renderPass, allocator);
+			}
+			vkDestroySwapchainKHR(device, retired.swapchain, allocator);
+		}
+		retiredSwapchains.erase(std::remove_if(retiredSwapchains.begin(), retiredSwapchains.end(), done), retiredSwapchains.end());
+	}
+	
+	VkFence takePresentFence() {
+		if (!freePresentFences.empty()) {
+			VkFence fence = freePresentFences.back();
+			freePresentFences.pop_back();
+			return fence;
+		}
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkFence fence;
+		if (vkCreateFence(device, &fenceInfo, allocator, &fence) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create present fence");
+		}
+		return fence;
+	}
+	
+	// recycles the fences of finished presents, wait: block until every present is done
+	void pollPresentFences(bool wait) {
+		for (auto it = presentFences.begin() ; it != presentFences.end() ; ) {
+			if (wait && vkWaitForFences(device, 1, &it->fence, VK_TRUE, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+				throw std::runtime_error("failed to wait for present fence");
+			}
+			if (vkGetFenceStatus(device, it->fence) != VK_SUCCESS) {
+				++it;
+				continue;
+			}
+			vkResetFences(device, 1, &it->fence);
+			freePresentFences.push_back(it->fence);
+			it = presentFences.erase(it);
+		}
+	}
+	
+	// after destroyRetiredSwapchains(true)
+	void destroyPresentFences() {
+		for (VkFence fence : freePresentFences) {
+			vkDestroyFence(device, fence, allocator);
+		}
+		freePresentFences.clear();
+	}
 	
-	bool isDeviceSuitable(const VkPhysicalDevice& device, const VkPhysicalDeviceFeatures& features) {
-		if (!features.geometryShader) return false; // geometry shader is necessary
-		QueueFamilyIndices indices = findQueueFamilies(device);
-		if (!indices.isComplete()) return false;
+	void createFrameContexts() {
+		// more frames in flight than swapchain images would only end up waiting in vkAcquireNextImageKHR
+		uint32_t frameCount = std::clamp(targetFramesInFlight(), 1u, static_cast<uint32_t>(swapchainImages.size()));
+		frames.resize(frameCount);
+		imagesInFlight.assign(swapchainImages.size(), 0);
+		memoryAllocator.createFrameArenas(frameCount);
 		
-		if (!deviceSupportsRequiredExtensions(device)) return false; // verifies swap chain support
+		const QueueFamilyIndices& indices = deviceProfile.queueFamilyIndices;
 		
-		SwapchainSupportDetails swapchainSupport = querySwapchainSupport(device);
-		bool swapchainIsAdequate = !swapchainSupport.formats.empty() && !swapchainSupport.presentModes.empty();
+		for (auto& frame : frames) {
+			VkCommandPoolCreateInfo poolInfo{};
+			poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // reset as a whole every frame
+			poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+			if (vkCreateCommandPool(device, &poolInfo, allocator, &frame.commandPool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create command pool");
+			}
+			
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = frame.commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate command buffer");
+			}
+			
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			if (vkCreateSemaphore(device, &semaphoreInfo, allocator, &frame.imageAvailable) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create frame synchronization objects");
+			}
+			
+			if (options.recordThreads > 1) {
+				frame.threadPools.resize(options.recordThreads);
+				for (auto& threadPool : frame.threadPools) {
+					if (vkCreateCommandPool(device, &poolInfo, allocator, &threadPool.pool) != VK_SUCCESS) {
+						throw std::runtime_error("failed to create command pool");
+					}
+				}
+			}
+		}
+		if (options.recordThreads > 1) {
+			jobSystem.init(options.recordThreads);
+		}
+		createGpuProfiler();
+		renderGraph.init(device, allocator, memoryAllocator, static_cast<uint32_t>(frames.size()));
+		if (bindlessEnabled) {
+			auto [maxTextures, maxBuffers] = bindlessTableSize();
+			bindlessTable.init(device, allocator, maxTextures, maxBuffers);
+			startupLog() << "bindless table: " << maxTextures << " textures, " << maxBuffers << " storage buffers\n";
+		}
+		if (!options.texturePath.empty()) {
+			createTextureStreamer();
+		}
+		if (!options.capturePath.empty()) {
+			frameCapture.init(memoryAllocator, options.captureFormat, options.capturePath, std::max(options.captureBuffers, static_cast<uint32_t>(frames.size())));
+		}
 		
-		return true;
+		startupLog() << "present policy " << presentPolicySettings(options.presentPolicy).name << ": present mode " << presentModeName(swapchainPresentMode)
+		          << ", frames in flight: " << frames.size() << " (swapchain images: " << swapchainImages.size() << ")\n";
 	}
 	
-	bool deviceSupportsRequiredExtensions(const VkPhysicalDevice& device) {
-		
-		uint32_t extensionCount;
-		VkResult result = vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
-		std::vector<VkExtensionProperties> supportedExtensions(extensionCount);
-		result = vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, supportedExtensions.data());
+	/* the table's bindings are update-after-bind and visible to every stage, so the update-after-bind limits apply,
+	   per stage and per set. both arrays together count against every stage's resource limit and the pool's */
+	std::pair<uint32_t, uint32_t> bindlessTableSize() {
+		VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexingProperties;
+		auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+		if (!getProperties2) {
+			throw std::runtime_error("bindless: vkGetPhysicalDeviceProperties2KHR is missing");
+		}
+		getProperties2(physicalDevice, &properties);
 		
-		for (const auto& requiredExtension : deviceExtensions) {
-			if (!deviceSupportsExtension(requiredExtension, supportedExtensions)) return false;
+		uint32_t maxTextures = std::min({4096u, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		                                 indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages});
+		uint32_t maxBuffers = std::min({4096u, indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+		                                indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers});
+		uint32_t maxResources = std::min(indexingProperties.maxPerStageUpdateAfterBindResources, indexingProperties.maxUpdateAfterBindDescriptorsInAllPools);
+		if (maxTextures + maxBuffers > maxResources) {
+			maxTextures = std::min(maxTextures, maxResources / 2);
+			maxBuffers = std::min(maxBuffers, maxResources - maxTextures);
 		}
-		return true;
+		return {maxTextures, maxBuffers};
 	}
 	
-	bool deviceSupportsExtension(const char* extension, std::vector<VkExtensionProperties>& supportedExtensions) {
+	void createGpuProfiler() {
+		PFN_vkCmdBeginDebugUtilsLabelEXT beginLabel = nullptr;
+		PFN_vkCmdEndDebugUtilsLabelEXT endLabel = nullptr;
+		if (debugUtilsEnabled()) {
+			beginLabel = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+			endLabel = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+		}
 		
-		for (const auto& supportedExtension : supportedExtensions) {			
-			if (0 == strcmp(supportedExtension.extensionName, extension)) {
-				std::cout << "success: device supports: " << extension << std::endl;
-				return true;
+		// 0 valid bits means the queue family can't write timestamps at all
+		uint32_t timestampValidBits = 0;
+		if (!options.gpuTracePath.empty()) {
+			timestampValidBits = deviceProfile.queueFamilies[deviceProfile.queueFamilyIndices.graphicsFamily.value()].timestampValidBits;
+			if (timestampValidBits == 0) {
+				startupLog() << "GPU timestamps: not supported on the graphics queue family\n";
 			}
 		}
-		return false;
+		gpuProfiler.init(device, allocator, deviceProfile.properties.limits.timestampPeriod, timestampValidBits,
+			static_cast<uint32_t>(frames.size()), beginLabel, endLabel);
 	}
 	
+	bool deviceExtensionEnabled(const char *name) const {
+		return std::find(enabledDeviceExtensions.begin(), enabledDeviceExtensions.end(), name) != enabledDeviceExtensions.end();
+	}
 	
-	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
-		QueueFamilyIndices indices;
-		uint32_t count;
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
-		std::vector<VkQueueFamilyProperties> queueFamilies{count};
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &count, queueFamilies.data());
-				
-		int32_t i = 0;
-		for (const auto& properties : queueFamilies) {
-			if (properties.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphicsFamily = i;				
-			}
-			VkBool32 supportsSurface{};
-			VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR( device, i, surface, &supportsSurface );
-			if (result != VK_SUCCESS) {
-				throw std::runtime_error("could not query surface support");
-			}
-			if (supportsSurface) {
-				indices.presentFamily = i;
-			}
-			
-			if (indices.isComplete()) {
-				break;
-			}
-			++i;
+	void createInstanceCuller() {
+		if (options.instanceCount == 0) return;
+		if (!deviceProfile.features.drawIndirectFirstInstance) {
+			throw std::runtime_error("--instances: the device can't start indirect draws at an instance other than 0");
 		}
+		PFN_vkCmdDrawIndexedIndirectCountKHR drawIndirectCount = nullptr;
+		if (deviceProfile.features.multiDrawIndirect && deviceExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+			drawIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+		}
+		uint32_t maxDrawIndirectCount = deviceProfile.features.multiDrawIndirect ? deviceProfile.properties.limits.maxDrawIndirectCount : 1;
 		
-		
-		return indices;
+		VkShaderModule cullShader = createShaderModule(files.read("shaders/cull_comp.spv"));
+		try {
+			instanceCuller.init(device, allocator, memoryAllocator, uploadRing, (VkDeviceSize{options.uploadRingMiB} << 20) / 4, pipelineCache,
+				cullShader, options.instanceCount, drawIndirectCount, maxDrawIndirectCount);
+		} catch (...) {
+			vkDestroyShaderModule(device, cullShader, allocator);
+			throw;
+		}
+		vkDestroyShaderModule(device, cullShader, allocator); // the pipeline keeps what it needs
 	}
 	
-	void createLogicalDevice() {
-		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-		
-		std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};		
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
-		queueCreateInfos.reserve(uniqueQueueFamilies.size());
-		
-		float queuePriority = 1.0f;
-		for(const auto& index : uniqueQueueFamilies) {
-			VkDeviceQueueCreateInfo queueCreateInfo{};
-			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queueCreateInfo.queueFamilyIndex = index;			
-			queueCreateInfo.queueCount = 1;
-			queueCreateInfo.pQueuePriorities = &queuePriority;
-			
-			queueCreateInfos.push_back(queueCreateInfo);
+	void createTextureStreamer() {
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR getMemoryProperties2 = nullptr;
+		if (deviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+			getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+				vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
 		}
+		textureStreamer.init(physicalDevice, device, allocator, memoryAllocator, uploadRing, (VkDeviceSize{options.uploadRingMiB} << 20) / 2,
+			bindlessEnabled ? &bindlessTable : nullptr, getMemoryProperties2, VkDeviceSize{options.textureBudgetMiB} << 20);
 		
-		VkPhysicalDeviceFeatures deviceFeatures{}; //need nothing for now
-		
-		VkDeviceCreateInfo createInfo {
-			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = NOT_UNDERSTOOD,
-			.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
-			.pQueueCreateInfos = queueCreateInfos.data(),
-			.enabledLayerCount = enableValidationLayers ? static_cast<uint32_t>(validationLayers.size()) : 0,
-			.ppEnabledLayerNames = enableValidationLayers ? validationLayers.data() : 0,
-			
-			.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
-			.ppEnabledExtensionNames = deviceExtensions.data(),
-			.pEnabledFeatures = &deviceFeatures,
-		};
-		
-		VkResult result = vkCreateDevice(physicalDevice, &createInfo, nullptr, &device);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("failed to create logical device");
+		std::vector<std::filesystem::path> paths;
+		for (const auto& entry : std::filesystem::directory_iterator(options.texturePath)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".ppm") paths.push_back(entry.path());
 		}
-		
-		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+		std::sort(paths.begin(), paths.end());
+		for (const auto& path : paths) {
+			textureStreamer.addTexture(path.string());
+		}
+		startupLog() << "texture streaming: " << paths.size() << " textures from " << options.texturePath << ", budget from "
+		          << (getMemoryProperties2 ? "VK_EXT_memory_budget" : "heap sizes") << '\n';
 	}
 	
-	void createSwapchain() {
-		SwapchainSupportDetails swapchainSupport = querySwapchainSupport(physicalDevice);
-		
-		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
-		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
-		VkExtent2D extent = chooseSwapExtent(swapchainSupport.capabilities);
-		
-		
-		/* sticking to minimum means that we may sometimes have to wait on the driver to 
-		   complete internal operations before we can acquire another image to render to */
-		uint32_t imageCount = swapchainSupport.capabilities.minImageCount + 1;
-		if (swapchainSupport.capabilities.maxImageCount != 0 && 
-		    imageCount > swapchainSupport.capabilities.maxImageCount) {
-			imageCount = swapchainSupport.capabilities.maxImageCount;
-		}
-		
-		VkSwapchainCreateInfoKHR createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-		createInfo.surface = surface;
-		createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.format;
-        createInfo.imageColorSpace = surfaceFormat.colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1; //"This is always 1 unless you are developing a stereoscopic 3D application"
-        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // render directly to images (no post processing)
-		
-		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-		uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
-		if (indices.graphicsFamily == indices.presentFamily) {
-			createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		} else {
-			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT; // avoid managing image ownership among queue families
-			createInfo.queueFamilyIndexCount = 2;
-			createInfo.pQueueFamilyIndices = queueFamilyIndices;
+	/* nothing samples the textures yet, so demand is simulated: a window of textures moves through the set,
+	   the one in its middle wants mip 0 and every step away from it one mip coarser */
+	void requestVisibleTextures() {
+		uint32_t count = textureStreamer.textureCount();
+		if (count == 0) return;
+		constexpr uint32_t VISIBLE = 8;
+		constexpr uint32_t FRAMES_PER_STEP = 30;
+		uint32_t center = static_cast<uint32_t>(frameCounter / FRAMES_PER_STEP % count);
+		for (uint32_t distance = 0 ; distance <= std::min(VISIBLE / 2, count / 2) ; ++distance) {
+			textureStreamer.request((center + distance) % count, distance, frameCounter);
+			textureStreamer.request((center + count - distance) % count, distance, frameCounter);
 		}
-        createInfo.preTransform = swapchainSupport.capabilities.currentTransform; // no special transform
-        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; //ignore alpha
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
-		
-		VkResult result = vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapchain);
-		if (result != VK_SUCCESS) {
-			throw std::runtime_error("failed creating swap chain");
+	}
+	
+	void destroyFrameContexts() {
+		jobSystem.shutdown();
+		textureStreamer.destroy(); // releases its bindless slots, so before the table
+		bindlessTable.destroy();
+		renderGraph.destroy();
+		frameCapture.destroy();
+		gpuProfiler.destroy();
+		for (auto& frame : frames) {
+			for (auto& threadPool : frame.threadPools) {
+				vkDestroyCommandPool(device, threadPool.pool, allocator);
+			}
+			vkDestroyFramebuffer(device, frame.offscreenFramebuffer, allocator);
+			vkDestroySemaphore(device, frame.imageAvailable, allocator);
+			vkDestroyCommandPool(device, frame.commandPool, allocator); // frees the command buffer too
 		}
-				
-		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
-		swapchainImages.resize(imageCount);
-		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
-		
-		swapchainImageExtent = extent;
-		swapchainImageFormat = surfaceFormat.format;
+		frames.clear();
 	}
 	
-	SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device) {
+	SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device) const {
 		SwapchainSupportDetails details{};
 		
 		VkSurfaceCapabilitiesKHR capabilities;
@@ -537,18 +7140,29 @@ private:
 	}
 	
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-		constexpr VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == preferredPresentMode) {
-				return availablePresentMode;
+		for (VkPresentModeKHR preferredPresentMode : presentPolicySettings(options.presentPolicy).presentModes) {
+			for (const auto& availablePresentMode : availablePresentModes) {
+				if (availablePresentMode == preferredPresentMode) {
+					return availablePresentMode;
+				}
 			}
 		}
 		return VK_PRESENT_MODE_FIFO_KHR; // guaranteed to exist
 	}
 	
+	uint32_t targetFramesInFlight() const {
+		return options.framesInFlight != 0 ? options.framesInFlight : presentPolicySettings(options.presentPolicy).framesInFlight;
+	}
+	
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
 		if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
 			return capabilities.currentExtent;
+		} else if (options.headless) {
+			// a headless surface has no size of its own, the swapchain decides
+			VkExtent2D actualExtent = {WIDTH, HEIGHT};
+			actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+			actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+			return actualExtent;
 		} else {
 			int width, height;
 			glfwGetFramebufferSize(window, &width, &height);
@@ -568,29 +7182,898 @@ private:
 	
 
     void mainLoop() {
-		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+		while (!shouldClose()) {
+			if (!options.headless) {
+				glfwPollEvents();
+			}
+			if (drawFrame()) {
+				++frameCounter;
+				if (frameCounter == 1) finishStartup();
+				if (frameCounter == 1 && options.defragment) defragmentMemory();
+			} else if (!options.headless) {
+				glfwWaitEvents(); // minimized, nothing to render until the window comes back
+			}
 		}
+		vkDeviceWaitIdle(device);
     }
+	
+	/* --defragment: by the end of the first frame the mesh uploads have landed and the graphics queue owns the
+	   buffers, so they can be copied on it. draws re-read meshVertexBuffer->buffer, nothing else holds the handles */
+	void defragmentMemory() {
+		vkDeviceWaitIdle(device); // frames in flight still read the old buffers
+		double fragmentationBefore = memoryAllocator.getStats().fragmentation();
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queues.family(QueueRole::Graphics);
+		VkCommandPool commandPool;
+		if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create defragmentation command pool");
+		}
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS ||
+		    vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			vkDestroyCommandPool(device, commandPool, allocator);
+			throw std::runtime_error("failed to record defragmentation");
+		}
+		DeviceMemoryAllocator::DefragmentationStats stats = memoryAllocator.defragment(commandBuffer);
+		vkEndCommandBuffer(commandBuffer);
+		
+		DeviceQueues::Submission submission;
+		submission.commandBuffers.push_back(commandBuffer);
+		queues.wait(QueueRole::Graphics, queues.submit(QueueRole::Graphics, submission));
+		stats.blocksReleased = memoryAllocator.finishDefragmentation();
+		vkDestroyCommandPool(device, commandPool, allocator);
+		
+		std::cout << "defragmentation: " << stats.buffersMoved << " buffers, " << stats.bytesMoved / 1024 << " KiB moved, "
+		          << stats.blocksReleased << " blocks released, fragmentation " << std::fixed << std::setprecision(3)
+		          << fragmentationBefore << " -> " << memoryAllocator.getStats().fragmentation() << '\n';
+	}
+	
+	// returns false if no frame was rendered because the window is minimized and there is no swapchain to render to
+	bool drawFrame() {
+		FrameContext& frame = frames[currentFrame];
+		profiler.enabled = frameTraceActive();
+		ScopedTimer frameTimer{profiler, "frame"};
+		
+		// only blocks if the GPU is still busy with the frame that used this context last time around
+		auto waitStart = std::chrono::steady_clock::now();
+		{
+			ScopedTimer timer{profiler, "waitForFrameValue"};
+			queues.wait(QueueRole::Graphics, frame.submittedValue);
+		}
+		double blockedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+		// contexts are used round robin and the timeline only grows, so that frame and all before it are done
+		framesCompleted = std::max(framesCompleted, frameCounter >= frames.size() ? frameCounter - frames.size() + 1 : 0);
+		destroyRetiredSwapchains(false);
+		if (!options.capturePath.empty()) {
+			frameCapture.collect(framesCompleted);
+		}
+		if (bindlessEnabled) {
+			bindlessTable.beginFrame(framesCompleted);
+		}
+		if (!options.texturePath.empty()) {
+			ScopedTimer timer{profiler, "textureStreaming"};
+			requestVisibleTextures();
+			textureStreamer.update(frameCounter, framesCompleted);
+		}
+		
+		uint32_t imageIndex;
+		std::chrono::steady_clock::time_point acquireStart;
+		VkResult result;
+		do {
+			if (swapchainOutOfDate && !recreateSwapchain()) {
+				return false;
+			}
+			acquireStart = std::chrono::steady_clock::now();
+			{
+				ScopedTimer timer{profiler, "vkAcquireNextImageKHR"};
+				result = vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+			}
+			blockedMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - acquireStart).count();
+			// out of date: the semaphore wasn't signaled and nothing was submitted, so the frame context can simply be used again
+			swapchainOutOfDate = result == VK_ERROR_OUT_OF_DATE_KHR;
+		} while (swapchainOutOfDate);
+		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+			throw std::runtime_error("failed to acquire swapchain image");
+		}
+		
+		// images can come back out of order, an older frame may still be rendering to this one
+		auto imageWaitStart = std::chrono::steady_clock::now();
+		queues.wait(QueueRole::Graphics, imagesInFlight[imageIndex]);
+		blockedMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imageWaitStart).count();
+		
+		vkResetCommandPool(device, frame.commandPool, 0);
+		for (auto& threadPool : frame.threadPools) {
+			vkResetCommandPool(device, threadPool.pool, 0);
+			threadPool.used = 0;
+		}
+		memoryAllocator.resetFrameArena(currentFrame);
+		
+		// this frame's uploads go out as one transfer batch, the frame waits on it and acquires what it wrote
+		uploadRing.flush();
+		DeviceQueues::Submission submission;
+		submission.waitSemaphores.push_back(frame.imageAvailable);
+		submission.waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		uploadRing.takeGraphicsWait(submission.waits);
+		auto recordStart = std::chrono::steady_clock::now();
+		{
+			ScopedTimer timer{profiler, "recordCommandBuffer"};
+			recordCommandBuffer(frame, imageIndex);
+		}
+		recordMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+		
+		submission.commandBuffers.push_back(frame.commandBuffer);
+		submission.signalSemaphores.push_back(renderFinishedSemaphores[imageIndex]);
+		{
+			ScopedTimer timer{profiler, "vkQueueSubmit"};
+			frame.submittedValue = queues.submit(QueueRole::Graphics, submission);
+		}
+		imagesInFlight[imageIndex] = frame.submittedValue;
+		gpuProfiler.frameSubmitted(profiler.now());
+		
+		VkPresentInfoKHR presentInfo{};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 1;
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphores[imageIndex];
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &swapchain;
+		presentInfo.pImageIndices = &imageIndex;
+		VkSwapchainPresentFenceInfoEXT presentFenceInfo{};
+		if (presentFencesEnabled) {
+			presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+			presentFenceInfo.swapchainCount = 1;
+			presentFences.push_back(PresentFence{takePresentFence(), swapchain});
+			presentFenceInfo.pFences = &presentFences.back().fence;
+			presentInfo.pNext = &presentFenceInfo;
+		}
+		
+		{
+			ScopedTimer timer{profiler, "vkQueuePresentKHR"};
+			result = queues.present(presentInfo);
+		}
+		framePacing.addFrame(acquireStart, std::chrono::steady_clock::now(), blockedMilliseconds);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+			swapchainOutOfDate = true; // the frame was still submitted, recreate before the next acquire
+		} else if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to present swapchain image");
+		}
+		
+		currentFrame = (currentFrame + 1) % frames.size();
+		return true;
+	}
+	
+	void recordCommandBuffer(FrameContext& frame, uint32_t imageIndex) {
+		VkCommandBuffer commandBuffer = frame.commandBuffer;
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer");
+		}
+		gpuProfiler.beginFrame(currentFrame, commandBuffer, frameTraceActive() ? &profiler : nullptr);
+		{
+			GpuScope frameScope{gpuProfiler, commandBuffer, "frame"};
+			buildFrameGraph(frame, imageIndex);
+			renderGraph.execute(commandBuffer);
+		}
+		
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer");
+		}
+	}
+	
+	/* upload acquire, main pass, with --blur downsample twice and upsample into the swapchain image, with --capture
+	   the readback. the swapchain image comes in from the acquire semaphore and leaves in PRESENT_SRC_KHR */
+	void buildFrameGraph(FrameContext& frame, uint32_t imageIndex) {
+		using Access = RenderGraph::Access;
+		const Access acquired{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED}; // the semaphore's wait stage
+		const Access presentable{VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+		const Access colorTarget{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		                         VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}; // renderPass clears and transitions it
+		const Access transferSource{VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+		const Access transferDestination{VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+		
+		renderGraph.begin(currentFrame);
+		RenderGraph::Resource backbuffer = renderGraph.importImage("swapchain", swapchainImages[imageIndex], acquired, presentable);
+		
+		// its barriers are for the uploaded resources, which the graph doesn't know about
+		renderGraph.addPass("upload acquire", [this](VkCommandBuffer commandBuffer, const RenderGraph&) {
+			GpuScope scope{gpuProfiler, commandBuffer, "upload acquire"};
+			uploadRing.recordAcquire(commandBuffer);
+		}, true);
+		
+		// the draw buffer is read by last frame's main pass, that's also how this frame leaves it
+		RenderGraph::Resource instanceDraws = 0, instanceDrawCount = 0;
+		if (instanceCuller.active()) {
+			const Access indirectRead{VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+			cameraViewProjection = orbitingCamera();
+			instanceDraws = renderGraph.importBuffer("instance draws", instanceCuller.getDrawBuffer(), indirectRead, indirectRead);
+			if (instanceCuller.compacted()) {
+				// printStats() reads the count on the host
+				const Access countRead{VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT};
+				instanceDrawCount = renderGraph.importBuffer("instance draw count", instanceCuller.getCountBuffer(), countRead, countRead);
+				uint32_t reset = renderGraph.addPass("reset draw count", [this](VkCommandBuffer commandBuffer, const RenderGraph&) {
+					GpuScope scope{gpuProfiler, commandBuffer, "reset draw count"};
+					instanceCuller.recordReset(commandBuffer);
+				});
+				renderGraph.write(reset, instanceDrawCount, Access{VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT});
+			}
+			uint32_t cull = renderGraph.addPass("cull", [this](VkCommandBuffer commandBuffer, const RenderGraph&) {
+				GpuScope scope{gpuProfiler, commandBuffer, "cull"};
+				instanceCuller.recordCull(commandBuffer, cameraViewProjection, meshIndexCount);
+			});
+			renderGraph.write(cull, instanceDraws, Access{VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT});
+			if (instanceCuller.compacted()) {
+				renderGraph.write(cull, instanceDrawCount, Access{VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT});
+			}
+		}
+		
+		RenderGraph::Resource scene = backbuffer;
+		if (options.blur) {
+			scene = renderGraph.createImage("scene", {swapchainImageFormat, swapchainImageExtent,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT});
+		}
+		uint32_t mainPass = renderGraph.addPass("main pass", [this, &frame, imageIndex, scene](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+			GpuScope scope{gpuProfiler, commandBuffer, "main pass"};
+			recordMainPass(frame, options.blur ? offscreenFramebuffer(frame, graph.getView(scene), graph.getGeneration()) : swapchainFramebuffers[imageIndex]);
+		});
+		renderGraph.write(mainPass, scene, colorTarget);
+		if (instanceCuller.active()) {
+			const Access indirectRead{VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+			renderGraph.read(mainPass, instanceDraws, indirectRead);
+			if (instanceCuller.compacted()) renderGraph.read(mainPass, instanceDrawCount, indirectRead);
+		}
+		
+		if (options.blur) {
+			// filtered down to a quarter and stretched back up, half and scene are dead by the time quarter is written
+			RenderGraph::Resource source = scene;
+			VkExtent2D sourceExtent = swapchainImageExtent;
+			const char *passNames[] = {"downsample half", "downsample quarter"};
+			const char *imageNames[] = {"half", "quarter"};
+			for (uint32_t level = 0 ; level < 2 ; ++level) {
+				VkExtent2D extent{std::max(sourceExtent.width / 2, 1u), std::max(sourceExtent.height / 2, 1u)};
+				RenderGraph::Resource target = renderGraph.createImage(imageNames[level], {swapchainImageFormat, extent,
+					VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT});
+				uint32_t pass = renderGraph.addPass(passNames[level], [=, this](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+					GpuScope scope{gpuProfiler, commandBuffer, passNames[level]};
+					recordBlit(commandBuffer, graph.getImage(source), sourceExtent, graph.getImage(target), extent);
+				});
+				renderGraph.read(pass, source, transferSource);
+				renderGraph.write(pass, target, transferDestination);
+				source = target;
+				sourceExtent = extent;
+			}
+			uint32_t upsample = renderGraph.addPass("upsample", [=, this](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+				GpuScope scope{gpuProfiler, commandBuffer, "upsample"};
+				recordBlit(commandBuffer, graph.getImage(source), sourceExtent, graph.getImage(backbuffer), swapchainImageExtent);
+			});
+			renderGraph.read(upsample, source, transferSource);
+			renderGraph.write(upsample, backbuffer, transferDestination);
+		}
+		
+		if (!options.capturePath.empty()) {
+			VkBuffer buffer = frameCapture.reserve(swapchainImageExtent, swapchainImageFormat, frameCounter);
+			if (buffer != VK_NULL_HANDLE) {
+				RenderGraph::Resource readback = renderGraph.importBuffer("capture", buffer, Access{}, Access{VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT});
+				uint32_t capture = renderGraph.addPass("capture", [this, backbuffer, buffer](VkCommandBuffer commandBuffer, const RenderGraph& graph) {
+					GpuScope scope{gpuProfiler, commandBuffer, "capture"};
+					FrameCapture::recordCopy(commandBuffer, graph.getImage(backbuffer), swapchainImageExtent, buffer);
+				});
+				renderGraph.read(capture, backbuffer, transferSource);
+				renderGraph.write(capture, readback, Access{VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT});
+			}
+		}
+		renderGraph.compile();
+	}
+	
+	// whole image to whole image, linear filtered; both in the layouts the graph put them in for transfers
+	void recordBlit(VkCommandBuffer commandBuffer, VkImage source, VkExtent2D sourceExtent, VkImage destination, VkExtent2D destinationExtent) {
+		VkImageBlit blit{};
+		blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		blit.srcOffsets[1] = {static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height), 1};
+		blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		blit.dstOffsets[1] = {static_cast<int32_t>(destinationExtent.width), static_cast<int32_t>(destinationExtent.height), 1};
+		vkCmdBlitImage(commandBuffer, source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+	}
+	
+	/* the frame slot's framebuffer around the graph's scene image, rebuilt when the graph replaced its images.
+	   the scene image follows the swapchain's format and extent, so a new render pass or extent means a new generation too */
+	VkFramebuffer offscreenFramebuffer(FrameContext& frame, VkImageView view, uint64_t generation) {
+		if (frame.offscreenGeneration == generation) return frame.offscreenFramebuffer;
+		vkDestroyFramebuffer(device, frame.offscreenFramebuffer, allocator); // the slot's last frame is done with it
+		frame.offscreenFramebuffer = VK_NULL_HANDLE;
+		frame.offscreenGeneration = 0;
+		
+		VkFramebufferCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		createInfo.renderPass = renderPass;
+		createInfo.attachmentCount = 1;
+		createInfo.pAttachments = &view;
+		createInfo.width = swapchainImageExtent.width;
+		createInfo.height = swapchainImageExtent.height;
+		createInfo.layers = 1;
+		if (vkCreateFramebuffer(device, &createInfo, allocator, &frame.offscreenFramebuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create offscreen framebuffer");
+		}
+		frame.offscreenGeneration = generation;
+		return frame.offscreenFramebuffer;
+	}
+	
+	void recordMainPass(FrameContext& frame, VkFramebuffer framebuffer) {
+		VkCommandBuffer commandBuffer = frame.commandBuffer;
+		VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = framebuffer;
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = swapchainImageExtent;
+		renderPassInfo.clearValueCount = 1;
+		renderPassInfo.pClearValues = &clearColor;
+		
+		if (instanceCuller.active()) {
+			// a handful of commands for any instance count, nothing worth spreading over threads
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordInstancedDraws(commandBuffer);
+		} else if (!frame.threadPools.empty()) {
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			std::vector<VkCommandBuffer> secondaries = recordDrawsParallel(frame, framebuffer);
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		} else {
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			recordDraws(commandBuffer, 0, options.drawCount);
+		}
+		vkCmdEndRenderPass(commandBuffer);
+	}
+	
+	/* splits the frame's draws into a few chunks per thread so a thread that finishes early can steal
+	   the rest, each chunk becomes one secondary command buffer from the recording thread's pool */
+	std::vector<VkCommandBuffer> recordDrawsParallel(FrameContext& frame, VkFramebuffer framebuffer) {
+		uint32_t chunkCount = std::min(options.drawCount, jobSystem.threadCount() * 4);
+		std::vector<VkCommandBuffer> secondaries(chunkCount);
+		
+		jobSystem.parallelFor(chunkCount, [&](uint32_t chunk, uint32_t thread) {
+			ThreadCommandPool& threadPool = frame.threadPools[thread];
+			if (threadPool.used == threadPool.secondaries.size()) {
+				VkCommandBufferAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.commandPool = threadPool.pool;
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocInfo.commandBufferCount = 1;
+				VkCommandBuffer secondary;
+				if (vkAllocateCommandBuffers(device, &allocInfo, &secondary) != VK_SUCCESS) {
+					throw std::runtime_error("failed to allocate secondary command buffer");
+				}
+				threadPool.secondaries.push_back(secondary);
+			}
+			VkCommandBuffer secondary = threadPool.secondaries[threadPool.used++];
+			
+			VkCommandBufferInheritanceInfo inheritanceInfo{};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = renderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = framebuffer;
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			beginInfo.pInheritanceInfo = &inheritanceInfo;
+			if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+				throw std::runtime_error("failed to begin recording secondary command buffer");
+			}
+			
+			uint32_t first = static_cast<uint32_t>(uint64_t{options.drawCount} * chunk / chunkCount);
+			uint32_t last = static_cast<uint32_t>(uint64_t{options.drawCount} * (chunk + 1) / chunkCount);
+			recordDraws(secondary, first, last - first);
+			
+			if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+				throw std::runtime_error("failed to record secondary command buffer");
+			}
+			secondaries[chunk] = secondary; // executed in chunk order no matter which thread recorded it
+		});
+		return secondaries;
+	}
+	
+	// the cull pass already decided what's drawn
+	void recordInstancedDraws(VkCommandBuffer commandBuffer) {
+		if (!pipelineManager.ready(instancedVariant)) {
+			recordDraws(commandBuffer, 0, options.drawCount); // the triangle stands in until it's compiled
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(instancedVariant));
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &meshVertexBuffer->buffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, meshIndexBuffer->buffer, 0, meshIndexType);
+		setViewportAndScissor(commandBuffer);
+		instanceCuller.recordDraws(commandBuffer, pipelineLayout, cameraViewProjection);
+	}
+	
+	// turns around the middle of the instances, so only a slice of them is ever in view
+	Mat4 orbitingCamera() const {
+		constexpr float PI = 3.14159265f;
+		float angle = static_cast<float>(frameCounter % 3600) * (2.0f * PI / 3600.0f);
+		float aspect = static_cast<float>(swapchainImageExtent.width) / static_cast<float>(std::max(swapchainImageExtent.height, 1u));
+		float far = 2.0f * instanceCuller.sceneRadius() + 1.0f;
+		return Mat4::perspective(PI / 3.0f, aspect, 0.1f, far) *
+		       Mat4::lookAt({0.0f, 0.0f, 0.0f}, {std::sin(angle), 0.0f, -std::cos(angle)}, {0.0f, 1.0f, 0.0f});
+	}
+	
+	void setViewportAndScissor(VkCommandBuffer commandBuffer) {
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(swapchainImageExtent.width);
+		viewport.height = static_cast<float>(swapchainImageExtent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		
+		VkRect2D scissor{};
+		scissor.offset = {0, 0};
+		scissor.extent = swapchainImageExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+	
+	// state isn't inherited by secondary command buffers, so every batch of draws sets up its own
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount) {
+		// the triangle stands in for the mesh until its pipeline has been compiled
+		bool drawMesh = meshVertexBuffer != nullptr && pipelineManager.ready(meshVariant);
+		if (drawMesh) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(meshVariant));
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &meshVertexBuffer->buffer, &offset);
+			vkCmdBindIndexBuffer(commandBuffer, meshIndexBuffer->buffer, 0, meshIndexType);
+		} else {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(colorModeVariants[options.colorMode]));
+		}
+		setViewportAndScissor(commandBuffer);
+		
+		for (uint32_t draw = firstDraw ; draw < firstDraw + drawCount ; ++draw) {
+			if (drawMesh) {
+				vkCmdDrawIndexed(commandBuffer, meshIndexCount, 1, 0, 0, draw);
+			} else {
+				vkCmdDraw(commandBuffer, 3, 1, 0, draw); // firstInstance only tells the draws apart in captures
+			}
+		}
+	}
+	
+	static constexpr VkDeviceSize BENCH_TRANSFER_BYTES = 32 << 20;  // per upload and readback sample
+	static constexpr uint32_t BENCH_FRAMES = 8;                     // per draw submission sample
+	
+	double startupScopeMilliseconds(const char *name) const {
+		double microseconds = 0.0;
+		for (const auto& event : profiler.getEvents()) {
+			if (event.name == name) microseconds += event.durationMicroseconds;
+		}
+		return microseconds / 1000.0;
+	}
+	
+	void benchmarkFrame() {
+		if (drawFrame()) {
+			++frameCounter;
+			if (frameCounter == 1) finishStartup();
+		}
+	}
+	
+	// the old swapchain retires as usual, a frame after each recreation lets it go
+	void benchmarkSwapchainRecreation(BenchmarkSuite& suite) {
+		suite.measure("swapchain_recreation", "ms", BenchmarkSuite::Better::Lower, [&] {
+			auto start = std::chrono::steady_clock::now();
+			if (!recreateSwapchain()) {
+				throw std::runtime_error("benchmark: no swapchain to recreate");
+			}
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			benchmarkFrame();
+			return milliseconds;
+		});
+	}
+	
+	/* through the upload ring like any streamed data: memcpy into staging, transfer batches, done once the
+	   transfer queue reached the last one. returns the uploaded buffer, owned by the graphics queue */
+	DeviceMemoryAllocator::Buffer* benchmarkUploads(BenchmarkSuite& suite) {
+		DeviceMemoryAllocator::Buffer *buffer = memoryAllocator.createBuffer(BENCH_TRANSFER_BYTES,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		std::vector<char> data(BENCH_TRANSFER_BYTES);
+		std::mt19937 random{1};
+		for (char& byte : data) byte = static_cast<char>(random());
+		VkDeviceSize chunkSize = std::min<VkDeviceSize>(4 << 20, (VkDeviceSize{options.uploadRingMiB} << 20) / 4);
+		
+		suite.measure("upload_throughput", "MiB/s", BenchmarkSuite::Better::Higher, [&] {
+			auto start = std::chrono::steady_clock::now();
+			for (VkDeviceSize offset = 0 ; offset < BENCH_TRANSFER_BYTES ; offset += chunkSize) {
+				uploadRing.uploadBuffer(buffer->buffer, offset, data.data() + offset, std::min(chunkSize, BENCH_TRANSFER_BYTES - offset),
+					VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+			}
+			uploadRing.flush();
+			queues.wait(QueueRole::Transfer, uploadRing.flushedValue());
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			benchmarkFrame(); // the graphics queue acquires the buffer
+			return BENCH_TRANSFER_BYTES / 1048576.0 / seconds;
+		});
+		return buffer;
+	}
+	
+	// GPU copy into host-visible memory on the graphics queue, then the CPU reads every byte of it
+	void benchmarkReadback(BenchmarkSuite& suite, DeviceMemoryAllocator::Buffer *source) {
+		DeviceMemoryAllocator::Buffer *readback = memoryAllocator.createBuffer(BENCH_TRANSFER_BYTES, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queues.family(QueueRole::Graphics);
+		VkCommandPool commandPool;
+		if (vkCreateCommandPool(device, &poolInfo, allocator, &commandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create benchmark command pool");
+		}
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS ||
+		    vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			vkDestroyCommandPool(device, commandPool, allocator);
+			throw std::runtime_error("failed to record benchmark readback");
+		}
+		VkBufferCopy copy{0, 0, BENCH_TRANSFER_BYTES};
+		vkCmdCopyBuffer(commandBuffer, source->buffer, readback->buffer, 1, &copy);
+		VkMemoryBarrier toHost{};
+		toHost.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &toHost, 0, nullptr, 0, nullptr);
+		vkEndCommandBuffer(commandBuffer);
+		
+		DeviceQueues::Submission submission;
+		submission.commandBuffers.push_back(commandBuffer); // reused, every sample waits for it
+		const uint64_t *words = static_cast<const uint64_t*>(readback->allocation.mapped);
+		volatile uint64_t checksum = 0; // the reads have a visible effect, so they can't be optimized away
+		suite.measure("readback_bandwidth", "MiB/s", BenchmarkSuite::Better::Higher, [&] {
+			auto start = std::chrono::steady_clock::now();
+			queues.wait(QueueRole::Graphics, queues.submit(QueueRole::Graphics, submission));
+			uint64_t sum = 0;
+			for (VkDeviceSize i = 0 ; i < BENCH_TRANSFER_BYTES / sizeof(uint64_t) ; ++i) {
+				sum += words[i];
+			}
+			checksum = sum;
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			return BENCH_TRANSFER_BYTES / 1048576.0 / seconds;
+		});
+		
+		vkDestroyCommandPool(device, commandPool, allocator);
+		memoryAllocator.destroyBuffer(readback);
+	}
+	
+	/* whole frames with batchSize draws each: draws per second of wall time until the GPU is done with them, and
+	   the CPU's share, recording. with --instances the culled draws replace these and the batch size does nothing */
+	void benchmarkDrawSubmission(BenchmarkSuite& suite) {
+		uint32_t drawCount = options.drawCount;
+		for (uint32_t batchSize : {1u, 16u, 256u, 4096u}) {
+			options.drawCount = batchSize;
+			std::string suffix = "_" + std::to_string(batchSize);
+			uint32_t samples = 0;
+			suite.measure("draw_submission" + suffix, "draws/s", BenchmarkSuite::Better::Higher, [&] {
+				double recordedBefore = recordMilliseconds;
+				auto start = std::chrono::steady_clock::now();
+				for (uint32_t frame = 0 ; frame < BENCH_FRAMES ; ++frame) {
+					benchmarkFrame();
+				}
+				vkDeviceWaitIdle(device);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (++samples > suite.warmupCount()) {
+					suite.add("draw_recording" + suffix, "ms/frame", BenchmarkSuite::Better::Lower, (recordMilliseconds - recordedBefore) / BENCH_FRAMES);
+				}
+				return static_cast<double>(batchSize) * BENCH_FRAMES / seconds;
+			});
+		}
+		options.drawCount = drawCount;
+	}
+	
+	bool shouldClose() {
+		if (options.frameCount != 0 && frameCounter >= options.frameCount) return true;
+		if (options.headless) return options.frameCount == 0; // nothing would ever stop us otherwise
+		return glfwWindowShouldClose(window);
+	}
 
     void cleanup() {
-		vkDestroySwapchainKHR(device, swapchain, nullptr);
-		vkDestroyDevice(device, nullptr);
+		if (frameCounter == 0) std::cout << deferredStartupOutput.str(); // never got to the first frame
+		if (!options.capturePath.empty()) {
+			frameCapture.collect(frameCounter); // mainLoop waited for the device, every frame is done
+			frameCapture.destroy();
+			frameCapture.printStats(std::cout);
+		}
+		destroyFrameContexts();
+		destroyRetiredSwapchains(true);
+		destroyPresentFences();
+		framePacing.print(std::cout);
+		printRecordingStats();
+		renderGraph.printStats(std::cout);
+		textureStreamer.printStats(std::cout);
+		instanceCuller.printStats(std::cout);
+		gpuProfiler.printSummary(std::cout);
+		if (!options.gpuTracePath.empty()) {
+			profiler.writeChromeTrace(options.gpuTracePath);
+			std::cout << "frame trace written to " << options.gpuTracePath << '\n';
+		}
+		if (swapchainRecreations != 0) {
+			std::cout << "swapchain recreated " << swapchainRecreations << " times\n";
+		}
+		uploadRing.printStats(std::cout);
+		uploadRing.destroy();
+		queues.printStats(std::cout);
+		queues.destroy();
+		memoryAllocator.destroyBuffer(meshIndexBuffer);
+		memoryAllocator.destroyBuffer(meshVertexBuffer);
+		instanceCuller.destroy();
+		pipelineManager.destroy(); // merges the variants' caches into pipelineCache before it is saved
+		pipelineManager.printStats(std::cout);
+		vkDestroyPipeline(device, graphicsPipeline, allocator);
+		vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+		printPipelineCacheStats();
+		savePipelineCache();
+		vkDestroyPipelineCache(device, pipelineCache, allocator);
+		for (auto framebuffer : swapchainFramebuffers) {
+			vkDestroyFramebuffer(device, framebuffer, allocator);
+		}
+		vkDestroyRenderPass(device, renderPass, allocator);
+		for (auto imageView : swapchainImageViews) {
+			vkDestroyImageView(device, imageView, allocator);
+		}
+		for (auto semaphore : renderFinishedSemaphores) {
+			vkDestroySemaphore(device, semaphore, allocator);
+		}
+		vkDestroySwapchainKHR(device, swapchain, allocator);
+		memoryAllocator.printStats(std::cout);
+		memoryAllocator.destroy();
+		vkDestroyDevice(device, allocator);
 		if (enableValidationLayers) {
-			destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+			destroyDebugUtilsMessengerEXT(instance, debugMessenger, allocator);
+		}
+		vkDestroySurfaceKHR(instance, surface, allocator);
+		vkDestroyInstance(instance, allocator);
+		validationSink.stop();
+		if (allocator) {
+			hostAllocator.printStats(std::cout);
+		}
+		if (!options.headless) {
+			glfwDestroyWindow(window);		
+			glfwTerminate();
 		}
-		vkDestroySurfaceKHR(instance, surface, nullptr);
-		vkDestroyInstance(instance, nullptr);
-		glfwDestroyWindow(window);		
-		glfwTerminate();
     }
 	
 	
 };
 
-int main() {
-    HelloTriangleApplication app;
+/* time to first frame with normal and fast start, alternating between them so drift (clocks, other processes)
+   hits both alike. the first run of each warms the pipeline and device caches and the OS file cache and isn't
+   counted. every run renders a single frame */
+static void benchmarkStartup(AppOptions options, uint32_t runs, std::ostream& out) {
+	options.frameCount = 1;
+	std::vector<double> samples[2]; // normal, fast
+	for (uint32_t run = 0 ; run <= runs ; ++run) {
+		for (int fast = 0 ; fast < 2 ; ++fast) {
+			options.fastStart = fast != 0;
+			HelloTriangleApplication app{options};
+			app.run();
+			if (run != 0) samples[fast].push_back(app.timeToFirstFrame());
+		}
+	}
+	
+	auto summarize = [&](const char *name, std::vector<double>& times) {
+		std::sort(times.begin(), times.end());
+		double mean = 0.0;
+		for (double time : times) mean += time / times.size();
+		double median = times[times.size() / 2];
+		out << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(2) << "median " << median
+		    << " ms, mean " << mean << " ms, best " << times.front() << " ms, worst " << times.back() << " ms\n";
+		return median;
+	};
+	out << "time to first frame, " << runs << " runs each:\n";
+	double normal = summarize("normal", samples[0]);
+	double fast = summarize("fast", samples[1]);
+	out << "fast start saves " << normal - fast << " ms (" << std::setprecision(1) << 100.0 * (normal - fast) / normal << "%) by the median\n";
+}
+
+/* --bench: instance and device creation over warm-up + repetitions fresh apps, then swapchain recreation,
+   upload and readback bandwidth and draw submission at several batch sizes inside one more. always headless,
+   so it runs the same on a batch node with only lavapipe. returns the number of regressions against the
+   baseline, 0 without one */
+static uint32_t runBenchmarkSuite(AppOptions options, std::ostream& out) {
+	options.headless = true;
+	options.frameCount = 0;
+	BenchmarkSuite suite{options.benchWarmup, options.benchRepetitions};
+	uint32_t startupRuns = suite.warmupCount() + suite.repetitionCount();
+	for (uint32_t run = 0 ; run < startupRuns ; ++run) {
+		HelloTriangleApplication app{options};
+		app.runBenchmarks(suite, run >= suite.warmupCount(), run + 1 == startupRuns);
+	}
+	
+	std::ofstream file(options.benchPath, std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open benchmark output: " + options.benchPath);
+	}
+	suite.writeJson(file);
+	if (!file.good()) {
+		throw std::runtime_error("failed to write " + options.benchPath);
+	}
+	suite.printSummary(out);
+	out << "benchmark results written to " << options.benchPath << '\n';
+	return options.benchBaselinePath.empty() ? 0 : suite.compare(options.benchBaselinePath, options.benchTolerance, options.benchAllowDeviceMismatch, out);
+}
+
+AppOptions parseOptions(int argc, char **argv) {
+	AppOptions options{};
+	for (int i = 1 ; i < argc ; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--headless") {
+			options.headless = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--pipeline-cache" && i + 1 < argc) {
+			options.pipelineCachePath = argv[++i];
+		} else if (arg == "--no-pipeline-cache") {
+			options.pipelineCachePath.clear();
+		} else if (arg == "--startup-trace" && i + 1 < argc) {
+			options.startupTracePath = argv[++i];
+		} else if (arg == "--device-cache" && i + 1 < argc) {
+			options.deviceCachePath = argv[++i];
+		} else if (arg == "--fast-start") {
+			options.fastStart = true;
+		} else if (arg == "--bench-startup" && i + 1 < argc) {
+			options.benchStartupRuns = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		} else if (arg == "--no-host-allocator") {
+			options.useHostAllocator = false;
+		} else if (arg == "--present-policy" && i + 1 < argc) {
+			std::string name = argv[++i];
+			bool found = false;
+			for (PresentPolicy policy : {PresentPolicy::Balanced, PresentPolicy::LowLatency, PresentPolicy::VsyncThroughput, PresentPolicy::Uncapped}) {
+				if (name == presentPolicySettings(policy).name) {
+					options.presentPolicy = policy;
+					found = true;
+				}
+			}
+			if (!found) {
+				throw std::runtime_error("unknown present policy: " + name);
+			}
+		} else if (arg == "--record-threads" && i + 1 < argc) {
+			options.recordThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (options.recordThreads == 0) options.recordThreads = std::max(1u, std::thread::hardware_concurrency());
+		} else if (arg == "--draws" && i + 1 < argc) {
+			options.drawCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		} else if (arg == "--gpu-trace" && i + 1 < argc) {
+			options.gpuTracePath = argv[++i];
+		} else if (arg == "--gpu-trace-frames" && i + 1 < argc) {
+			options.gpuTraceFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--debug-labels") {
+			options.debugLabels = true;
+		} else if (arg == "--capture" && i + 1 < argc) {
+			options.capturePath = argv[++i];
+		} else if (arg == "--capture-format" && i + 1 < argc) {
+			std::string format = argv[++i];
+			if (format == "raw") options.captureFormat = CaptureFormat::Raw;
+			else if (format == "ppm") options.captureFormat = CaptureFormat::Ppm;
+			else if (format == "stream") options.captureFormat = CaptureFormat::Stream;
+			else throw std::runtime_error("unknown capture format: " + format);
+		} else if (arg == "--capture-buffers" && i + 1 < argc) {
+			options.captureBuffers = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--no-bindless") {
+			options.bindless = false;
+		} else if (arg == "--no-timeline") {
+			options.timelines = false;
+		} else if (arg == "--bench" && i + 1 < argc) {
+			options.benchPath = argv[++i];
+		} else if (arg == "--bench-baseline" && i + 1 < argc) {
+			options.benchBaselinePath = argv[++i];
+		} else if (arg == "--bench-warmup" && i + 1 < argc) {
+			options.benchWarmup = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--bench-repetitions" && i + 1 < argc) {
+			options.benchRepetitions = std::max(2u, static_cast<uint32_t>(std::stoul(argv[++i]))); // a variance needs two
+		} else if (arg == "--bench-tolerance" && i + 1 < argc) {
+			options.benchTolerance = std::stod(argv[++i]) / 100.0;
+		} else if (arg == "--bench-allow-device-mismatch") {
+			options.benchAllowDeviceMismatch = true;
+		} else if (arg == "--color-mode" && i + 1 < argc) {
+			options.colorMode = static_cast<uint32_t>(std::stoul(argv[++i]));
+			if (options.colorMode > 2) throw std::runtime_error("color mode must be 0, 1 or 2");
+		} else if (arg == "--pipeline-threads" && i + 1 < argc) {
+			options.pipelineThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--mesh" && i + 1 < argc) {
+			options.meshPath = argv[++i];
+		} else if (arg == "--defragment") {
+			options.defragment = true;
+		} else if (arg == "--instances" && i + 1 < argc) {
+			options.instanceCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		} else if (arg == "--blur") {
+			options.blur = true;
+		} else if (arg == "--textures" && i + 1 < argc) {
+			options.texturePath = argv[++i];
+		} else if (arg == "--texture-budget" && i + 1 < argc) {
+			options.textureBudgetMiB = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		} else if (arg == "--upload-ring" && i + 1 < argc) {
+			options.uploadRingMiB = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+		} else {
+			throw std::runtime_error("unknown argument: " + arg);
+		}
+	}
+	if (options.headless && options.frameCount == 0) {
+		options.frameCount = 1000;
+	}
+	return options;
+}
+
+int main(int argc, char **argv) {
 	std::cout << "hello\n";
+	
+	// offline tools, no window or device involved
+	if (argc >= 2 && std::string(argv[1]) == "--convert-mesh") {
+		try {
+			if (argc != 4) throw std::runtime_error("usage: " + std::string(argv[0]) + " --convert-mesh INPUT.obj OUTPUT.mesh");
+			convertObjToMesh(argv[2], argv[3]);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	if (argc >= 2 && std::string(argv[1]) == "--bench-mesh") {
+		try {
+			if (argc != 4 && argc != 5) throw std::runtime_error("usage: " + std::string(argv[0]) + " --bench-mesh INPUT.obj INPUT.mesh [REPETITIONS]");
+			benchmarkMeshLoad(argv[2], argv[3], argc == 5 ? std::max(1u, static_cast<uint32_t>(std::stoul(argv[4]))) : 10u, std::cout);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	
+	AppOptions options;
+	try {
+		options = parseOptions(argc, argv);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		std::cerr << "usage: " << argv[0] << " [--headless] [--frames N] [--frames-in-flight N] [--pipeline-cache PATH | --no-pipeline-cache] [--startup-trace PATH] [--device-cache PATH] [--fast-start] [--bench-startup RUNS] [--bench OUT.json [--bench-baseline BASELINE.json] [--bench-warmup N] [--bench-repetitions N] [--bench-tolerance PERCENT] [--bench-allow-device-mismatch]] [--no-host-allocator] [--upload-ring MiB] [--record-threads N (0 = all cores)] [--draws N] [--gpu-trace PATH] [--gpu-trace-frames N] [--debug-labels] [--capture PATH] [--capture-format raw|ppm|stream] [--capture-buffers N] [--no-bindless] [--no-timeline] [--color-mode 0|1|2] [--pipeline-threads N] [--mesh PATH] [--instances N] [--defragment] [--textures DIR] [--texture-budget MiB] [--blur] [--present-policy balanced|low-latency|vsync-throughput|uncapped]\n"
+		          << "       " << argv[0] << " --convert-mesh INPUT.obj OUTPUT.mesh\n"
+		          << "       " << argv[0] << " --bench-mesh INPUT.obj INPUT.mesh [REPETITIONS]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!options.benchPath.empty()) {
+		try {
+			uint32_t regressions = runBenchmarkSuite(options, std::cout);
+			if (regressions != 0) {
+				std::cerr << regressions << " benchmark regression(s)" << std::endl;
+				return EXIT_FAILURE;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	if (options.benchStartupRuns != 0) {
+		try {
+			benchmarkStartup(options, options.benchStartupRuns, std::cout);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+    HelloTriangleApplication app{options};
 
     try {
         app.run();